@@ -0,0 +1,361 @@
+#include <iostream>
+#include <fstream>
+#include <sstream>
+#include <vector>
+#include <map>
+#include <string>
+#include <algorithm>
+#include <random>
+#include <stdexcept>
+#include "particles.h"
+#include "boris.h"
+#include "units.h"
+#include "sor.h"
+#include "carlo.h"
+#include "porous.h"
+#include "utils.h"
+
+//One kernel at one problem size, the times are per run in seconds and the throughput is in units per second
+struct BenchmarkResult {
+    std::string name;
+    uint size;
+    std::string unit;
+    double median, min, max;
+    double throughput;
+
+    double spread() const {
+        return (max - min) / median;
+    }
+};
+
+//Run setup (not timed) and run (timed) warmups + repetitions times, run returns the number of processed units
+template<typename Setup, typename Run>
+BenchmarkResult benchmark(
+        const std::string &name,
+        uint size,
+        const std::string &unit,
+        Setup setup,
+        Run run,
+        int repetitions = 7,
+        int warmups = 1
+) {
+    std::vector<double> durations;
+    double units = 0;
+    for (int i = -warmups; i < repetitions; i++) {
+        setup();
+        double count = 0;
+        auto duration = timeIt([&]() { count = run(); });
+        if (i < 0) continue;
+        durations.emplace_back(duration);
+        units += count;
+    }
+    std::sort(durations.begin(), durations.end());
+    auto middle = durations.size() / 2;
+    auto median = durations.size() % 2 ? durations[middle] : 0.5 * (durations[middle - 1] + durations[middle]);
+    return {name, size, unit, median, durations.front(), durations.back(), units / repetitions / median};
+}
+
+struct SoftGravitationalLaw {
+    Vector operator()(const Particle &a, const Particle &b) const {
+        auto r = b.position - a.position;
+        auto r2 = r.x * r.x + r.y * r.y + r.z * r.z + 1e-6;
+        return a.mass * b.mass / (r2 * std::sqrt(r2)) * r;
+    }
+};
+
+std::vector<Particle> getBenchmarkParticles(size_t count) {
+    auto particles = generateInRectangle(count, {0, 1}, {0, 1}, 9.10938356e-31);
+    setThermalVelocities(particles, 11600);
+    for (auto &particle : particles) {
+        particle.charge = -1.60217662e-19;
+    }
+    return particles;
+}
+
+std::vector<BenchmarkResult> runBenchmarks(const std::string &filter) {
+    std::vector<BenchmarkResult> results;
+    auto add = [&](const BenchmarkResult &result) {
+        std::cout << result.name << " " << result.size << ": median " << result.median << "s, spread "
+                  << 100 * result.spread() << "%, " << result.throughput << " " << result.unit << "/s" << std::endl;
+        results.emplace_back(result);
+    };
+    auto enabled = [&](const std::string &name) {
+        return filter.empty() || name.find(filter) != std::string::npos;
+    };
+
+    if (enabled("updateForces")) {
+        for (uint size : {100u, 300u, 1000u}) {
+            auto particles = getBenchmarkParticles(size);
+            SoftGravitationalLaw forceCalculator;
+            add(benchmark("updateForces", size, "pairs", [&]() { setAllForces(particles, {0, 0}); }, [&]() {
+                updateForces(particles, forceCalculator);
+                return 0.5 * size * (size - 1);
+            }));
+        }
+    }
+
+    if (enabled("cellListForces")) {
+        //About 30 partners within the cutoff whatever the particle count, so the time per particle should stay flat
+        for (uint size : {10000u, 100000u, 300000u}) {
+            auto particles = getBenchmarkParticles(size);
+            const Interval side{0, 1};
+            CellList cells(side, side, std::sqrt(30 / (M_PI * size)));
+            ScreenedCoulombLaw forceCalculator{0.5 * std::sqrt(30 / (M_PI * size))};
+            add(benchmark("cellListForces", size, "particles", [&]() { setAllForces(particles, {0, 0}); }, [&]() {
+                cells.updateForces(particles, forceCalculator);
+                return (double) size;
+            }));
+        }
+    }
+
+    if (enabled("cellListForcesSorted")) {
+        //Same as cellListForces with the particles in Morton order, see SpatialSorter
+        for (uint size : {10000u, 100000u, 300000u}) {
+            auto particles = getBenchmarkParticles(size);
+            const Interval side{0, 1};
+            SpatialSorter sorter(side, side, 1);
+            sorter.sort(particles, 0);
+            CellList cells(side, side, std::sqrt(30 / (M_PI * size)));
+            ScreenedCoulombLaw forceCalculator{0.5 * std::sqrt(30 / (M_PI * size))};
+            add(benchmark("cellListForcesSorted", size, "particles", [&]() { setAllForces(particles, {0, 0}); }, [&]() {
+                cells.updateForces(particles, forceCalculator);
+                return (double) size;
+            }));
+        }
+    }
+
+    if (enabled("spatialSort")) {
+        for (uint size : {10000u, 100000u, 1000000u}) {
+            auto particles = getBenchmarkParticles(size);
+            const Interval side{0, 1};
+            SpatialSorter sorter(side, side, 1);
+            //Shuffled again before every run, otherwise the input is already sorted
+            auto shuffle = [&]() { std::shuffle(particles.begin(), particles.end(), getRandomEngine()); };
+            add(benchmark("spatialSort", size, "particles", shuffle, [&]() {
+                sorter.sort(particles, 0);
+                return (double) size;
+            }));
+        }
+    }
+
+    if (enabled("borisUpdateVelocity")) {
+        for (uint size : {10000u, 100000u, 1000000u}) {
+            auto particles = getBenchmarkParticles(size);
+            const Vector E = {1e8, 0, 0};
+            const Vector B = {0, 0, 1};
+            add(benchmark("borisUpdateVelocity", size, "particles", []() {}, [&]() {
+                borisUpdateVelocity(particles, 1e-12, E, B);
+                return (double) size;
+            }));
+        }
+    }
+
+    if (enabled("borisBlockUpdateVelocity")) {
+        //Same particles as a structure of arrays, see BasicParticleBlock
+        for (uint size : {10000u, 100000u, 1000000u}) {
+            auto block = splitBySpecies(getBenchmarkParticles(size)).front();
+            const Vector E = {1e8, 0, 0};
+            const Vector B = {0, 0, 1};
+            add(benchmark("borisBlockUpdateVelocity", size, "particles", []() {}, [&]() {
+                borisUpdateVelocity(block, 1e-12, E, B);
+                return (double) size;
+            }));
+        }
+    }
+
+    if (enabled("borisScaledUpdateVelocity")) {
+        //Dimensionless block stored as Scalar, see units.h
+        for (uint size : {10000u, 100000u, 1000000u}) {
+            auto block = splitBySpecies(getBenchmarkParticles(size)).front();
+            auto units = UnitSystem::forSpecies(block.mass, block.charge, 1e-12, 1e-4);
+            auto scaled = toScaled<Scalar>(block, units);
+            const auto E = units.scaleElectricField({1e8, 0, 0});
+            const auto B = units.scaleMagneticField({0, 0, 1});
+            add(benchmark("borisScaledUpdateVelocity", size, "particles", []() {}, [&]() {
+                borisUpdateVelocity(scaled, 1, E, B);
+                return (double) size;
+            }));
+        }
+    }
+
+    if (enabled("collide")) {
+        for (uint size : {1000u, 10000u, 100000u}) {
+            auto particles = getBenchmarkParticles(size);
+            const double argonMass = 6.6335209e-26;
+            const double maxFrequency = 1e9;
+            auto frequency = [](double) { return 0.5e9; };
+            //All the particles are due to collide
+            auto setup = [&]() {
+                for (auto &particle : particles) particle.nextCollisionTime = 0;
+            };
+            add(benchmark("collide", size, "particles", setup, [&]() {
+                collide(particles, argonMass, 1, maxFrequency, frequency);
+                return (double) size;
+            }));
+        }
+    }
+
+    if (enabled("collideTable")) {
+        //Frequency rising steeply with the speed, so a single global majorant would reject most of the events
+        std::vector<double> frequencies;
+        const double speedStep = 1e3;
+        for (int i = 0; i < 4096; i++) {
+            auto speed = i * speedStep;
+            frequencies.emplace_back(1e9 * std::pow(speed / (4095 * speedStep), 3));
+        }
+        CollisionTable table({{"elastic", 0, frequencies}}, speedStep);
+        for (uint size : {1000u, 10000u, 100000u}) {
+            auto particles = getBenchmarkParticles(size);
+            const double argonMass = 6.6335209e-26;
+            auto setup = [&]() {
+                for (auto &particle : particles) particle.nextCollisionTime = 0;
+            };
+            add(benchmark("collideTable", size, "particles", setup, [&]() {
+                collide(particles, argonMass, 1, table);
+                return (double) size;
+            }));
+        }
+    }
+
+    if (enabled("sor")) {
+        for (uint size : {33u, 65u, 129u}) {
+            Vector2D<double> initial(size), phi(size), r(size);
+            double step = 1.0 / (size - 1);
+            for (uint i = 0; i < size; i++) {
+                for (uint j = 0; j < size; j++) {
+                    if (isBorder({i, j}, size)) initial[{i, j}] = analyticFunction(i * step, j * step);
+                }
+            }
+            add(benchmark("sor", size, "node updates", [&]() { phi = initial; }, [&]() {
+                auto sweeps = sorIterate(step, 1.9, phi, r);
+                return (double) sweeps * (size - 2) * (size - 2);
+            }));
+        }
+    }
+
+    if (enabled("generateCarloValues")) {
+        for (uint size : {21u, 51u, 101u}) {
+            RectGrid<double> grid((int) size, 1.0);
+            const GridPoint startPoint{((int) size - 1) / 2, ((int) size - 1) / 2};
+            std::vector<double> values(1000);
+            add(benchmark("generateCarloValues", size, "walks", []() {}, [&]() {
+                generateCarloValues(values.begin(), values.end(), startPoint, grid);
+                return (double) values.size();
+            }));
+        }
+    }
+
+    if (enabled("pathExists")) {
+        for (uint size : {256u, 1024u, 4096u}) {
+            Grid grid(size, size);
+            std::seed_seq seeds{size};
+            grid.seed(seeds);
+            //Close to the threshold where the search visits the most sites
+            add(benchmark("pathExists", size, "sites", [&]() { grid.fillRandomly(0.4); }, [&]() {
+                pathExists(grid);
+                return (double) size * size;
+            }));
+        }
+    }
+
+    if (enabled("bitGridPathExists")) {
+        //Same lattices as pathExists on the bit packed grid, see BitGrid::pathExists
+        for (uint size : {256u, 1024u, 4096u}) {
+            BitGrid grid(size, size);
+            std::seed_seq seeds{size};
+            grid.seed(seeds);
+            //Close to the threshold where the flood fill needs the most sweeps
+            add(benchmark("bitGridPathExists", size, "sites", [&]() { grid.fillRandomly(0.4); }, [&]() {
+                grid.pathExists();
+                return (double) size * size;
+            }));
+        }
+    }
+    return results;
+}
+
+//One result per line so readResults does not need a JSON library
+void writeResults(const std::string &filename, const std::vector<BenchmarkResult> &results) {
+    std::ofstream file(filename);
+    file.precision(9);
+    file << "[" << std::endl;
+    for (size_t i = 0; i < results.size(); i++) {
+        const auto &result = results[i];
+        file << "{\"name\":\"" << result.name << "\",\"size\":" << result.size << ",\"unit\":\"" << result.unit
+             << "\",\"median\":" << result.median << ",\"min\":" << result.min << ",\"max\":" << result.max
+             << ",\"throughput\":" << result.throughput << "}" << (i + 1 < results.size() ? "," : "") << std::endl;
+    }
+    file << "]" << std::endl;
+}
+
+std::string getField(const std::string &line, const std::string &key) {
+    auto begin = line.find("\"" + key + "\":");
+    if (begin == std::string::npos) throw std::runtime_error("Missing " + key + " in: " + line);
+    begin += key.size() + 3;
+    if (line[begin] == '"') {
+        begin++;
+        return line.substr(begin, line.find('"', begin) - begin);
+    }
+    return line.substr(begin, line.find_first_of(",}", begin) - begin);
+}
+
+std::vector<BenchmarkResult> readResults(const std::string &filename) {
+    std::ifstream file(filename);
+    if (!file) throw std::runtime_error("Cannot open " + filename);
+    std::vector<BenchmarkResult> results;
+    std::string line;
+    while (std::getline(file, line)) {
+        if (line.find("\"name\"") == std::string::npos) continue;
+        results.push_back({
+                getField(line, "name"),
+                (uint) std::stoul(getField(line, "size")),
+                getField(line, "unit"),
+                std::stod(getField(line, "median")),
+                std::stod(getField(line, "min")),
+                std::stod(getField(line, "max")),
+                std::stod(getField(line, "throughput"))
+        });
+    }
+    return results;
+}
+
+//Compare the medians of the benchmarks present in both files, a run slower by more than tolerance is a regression
+int compareResults(const std::string &baselineFilename, const std::string &currentFilename, double tolerance) {
+    std::map<std::pair<std::string, uint>, BenchmarkResult> baseline;
+    for (const auto &result : readResults(baselineFilename)) {
+        baseline.emplace(std::make_pair(result.name, result.size), result);
+    }
+
+    int regressions = 0;
+    for (const auto &current : readResults(currentFilename)) {
+        auto it = baseline.find({current.name, current.size});
+        if (it == baseline.end()) continue;
+        auto ratio = current.median / it->second.median;
+        //Differences within the spread of the runs are noise
+        auto noise = std::max(it->second.spread(), current.spread());
+        auto isRegression = ratio > 1 + std::max(tolerance, noise);
+        if (isRegression) regressions++;
+        std::cout << current.name << " " << current.size << ": " << it->second.median << "s -> " << current.median
+                  << "s (x" << ratio << ")" << (isRegression ? " REGRESSION" : "") << std::endl;
+    }
+    std::cout << regressions << " regressions" << std::endl;
+    return regressions > 0 ? 1 : 0;
+}
+
+//Usage: Bench [output.json] [filter]
+//       Bench compare baseline.json current.json [tolerance]
+int main(int argc, char *argv[]) {
+    std::vector<std::string> arguments(argv + 1, argv + argc);
+    if (!arguments.empty() && arguments[0] == "compare") {
+        if (arguments.size() < 3) {
+            std::cerr << "Usage: Bench compare baseline.json current.json [tolerance]" << std::endl;
+            return 2;
+        }
+        auto tolerance = arguments.size() > 3 ? std::stod(arguments[3]) : 0.1;
+        return compareResults(arguments[1], arguments[2], tolerance);
+    }
+
+    auto filename = arguments.size() > 0 ? arguments[0] : "data/bench.json";
+    auto filter = arguments.size() > 1 ? arguments[1] : "";
+    writeResults(filename, runBenchmarks(filter));
+}
@@ -1,24 +1,11 @@
 #include <chrono>
 #include "particles.h"
+#include "boris.h"
+#include "units.h"
+#include "utils.h"
+#include "ensemble.h"
 
-void borisUpdateVelocity(std::vector<Particle>& particles, double timeStep, const Vector& E, const Vector& B){
-    for (auto& particle : particles){
-        auto q = particle.charge;
-        auto dt = timeStep;
-        auto m = particle.mass;
-        auto b = B.getNorm();
-        auto v1 = particle.velocity + q*dt/2/m*E;
-        auto f1 = std::tan(q*dt/2/m * b) / b;
-        auto v2 = v1 + f1 * (v1.cross(B));
-        auto f2 = 2*f1 / (1 + f1*f1 * (b*b));
-        auto v3 = v1 + f2 * (v2.cross(B));
-
-        particle.previousVelocity = particle.velocity;
-        particle.velocity = v3 + q*dt/2/m*E;
-    }
-}
-
-void run_boris(double timeStep, const std::string& filename) {
+void run_boris(double timeStep, std::ostream& output) {
     double time = 0;
     int step = 0;
     double finalTime = 1e-10;
@@ -57,11 +44,134 @@ void run_boris(double timeStep, const std::string& filename) {
 
     std::cout << "Execution took: " << duration << "s." << std::endl;
 
-    saveTrajectories(filename, particles);
+    saveTrajectories(output, particles);
+}
+
+//Electron and proton in the magnetic field of run_boris and the electric field E, the base step is sized for the
+//proton and the electron sub-cycles, see adaptiveBorisStep
+void run_boris_adaptive(double baseTimeStep, const Vector &E, std::ostream& output) {
+    double time = 0;
+    double finalTime = 1e-10;
+    int printCount = 100;
+
+    const Vector B = {0, 0, 1};
+    auto getE = [&E](const Vector&){ return E; };
+    auto getB = [&B](const Vector&){ return B; };
+    Particle electron(9.10938356e-31, {0,0,0},{2e8,0,0}, 1.60217662e-19);
+    Particle proton(1.6726219e-27, {0,0,0},{2e5,0,0}, 1.60217662e-19);
+    std::vector<Particle> particles = {electron, proton};
+
+    std::vector<double> printTimes;
+    for (int i = 1; i <= printCount; i++) printTimes.emplace_back(i * finalTime / printCount);
+
+    AdaptiveTimeStep settings{baseTimeStep};
+    long subSteps = 0;
+
+    auto start = std::chrono::high_resolution_clock::now();
+
+    while (time < finalTime * (1 - 1e-12)){
+        //main routine
+        //Every particle makes as many sub-steps as its cyclotron frequency and the field gradients require
+        subSteps += adaptiveBorisStep<BorisPush>(particles, time, settings, getE, getB, printTimes);
+        time += baseTimeStep;
+    }
+
+    auto end = std::chrono::high_resolution_clock::now();
+    auto nanosecondDuration = std::chrono::duration_cast<std::chrono::nanoseconds>(end - start).count();
+    auto duration = nanosecondDuration * 1e-9;
+
+    std::cout << "Execution took: " << duration << "s, sub-steps: " << subSteps << std::endl;
+
+    saveTrajectories(output, particles);
+}
+
+//Compare the particle by particle pusher with the scaled species blocks,
+//see borisUpdateVelocity(BasicParticleBlock<T>&, ...)
+void benchmarkPushers(size_t particleCount, int steps) {
+    const double timeStep = 1e-12;
+    const Vector E = {1e8, 0, 0};
+    const Vector B = {0, 0, 1};
+    auto particles = generateInRectangle(particleCount, {0, 1}, {0, 1}, 9.10938356e-31);
+    setThermalVelocities(particles, 11600);
+    for (size_t i = 0; i < particles.size(); i++) {
+        particles[i].charge = -1.60217662e-19;
+        if (i % 2) {
+            particles[i].mass = 1.6726219e-27;
+            particles[i].charge = 1.60217662e-19;
+        }
+    }
+    //Every species in its own units stored as Scalar, see units.h
+    std::vector<BasicParticleBlock<Scalar>> blocks;
+    std::vector<UnitSystem> units;
+    for (const auto &block : splitBySpecies(particles)) {
+        units.emplace_back(UnitSystem::forSpecies(block.mass, block.charge, timeStep, 1e-4));
+        blocks.emplace_back(toScaled<Scalar>(block, units.back()));
+    }
+
+    auto particlesDuration = timeIt([&]() {
+        for (int step = 0; step < steps; step++) {
+            borisUpdateVelocity(particles, timeStep, E, B);
+            updatePositions(particles, timeStep);
+        }
+    });
+    auto blocksDuration = timeIt([&]() {
+        for (int step = 0; step < steps; step++) {
+            for (size_t k = 0; k < blocks.size(); k++) {
+                auto scaledTimeStep = timeStep / units[k].time;
+                auto scaledE = units[k].scaleElectricField(E), scaledB = units[k].scaleMagneticField(B);
+                borisUpdateVelocity(blocks[k], scaledTimeStep, scaledE, scaledB);
+                updatePositions(blocks[k], scaledTimeStep);
+            }
+        }
+    });
+
+    std::cout << "Particle pusher: " << particleCount * steps / particlesDuration << " particles/s" << std::endl;
+    std::cout << "Species block pusher (scaled, " << (sizeof(Scalar) == sizeof(float) ? "float" : "double") << "): "
+              << particleCount * steps / blocksDuration << " particles/s" << std::endl;
+}
+
+//Deviation of the dimensionless double and float pushers from the SI pusher, see reportScaledPrecision
+void reportPusherPrecision(size_t particleCount, int steps) {
+    const double timeStep = 1e-12;
+    const Vector E = {1e8, 0, 0};
+    const Vector B = {0, 0, 1};
+    auto particles = generateInRectangle(particleCount, {0, 1e-3}, {0, 1e-3}, 9.10938356e-31);
+    setThermalVelocities(particles, 11600);
+    for (auto &particle : particles) {
+        particle.charge = -1.60217662e-19;
+    }
+    auto block = splitBySpecies(particles).front();
+    //The E x B drift of 1e8 m/s moves the electrons by 1e-4 m per step
+    auto units = UnitSystem::forSpecies(block.mass, block.charge, timeStep, 1e-4);
+    auto push = [](auto &block, double dt, const Vector &E, const Vector &B) {
+        borisUpdateVelocity(block, dt, E, B);
+        updatePositions(block, dt);
+    };
+    reportScaledPrecision(block, units, timeStep, E, B, steps, push);
 }
 
 int main(int argc, char *argv[]) {
-    run_boris(1e-12, "data/boris_trajectories_e-12.csv");
-    run_boris(1e-16, "data/boris_trajectories_e-16.csv");
+    //The runs are independent, each one saves its trajectories to its own file, see EnsembleRunner
+    EnsembleRunner ensemble;
+    ensemble.add("boris e-12", "data/boris_trajectories_e-12.csv", [](RunContext &context) {
+        run_boris(1e-12, context.output);
+    });
+    ensemble.add("boris e-16", "data/boris_trajectories_e-16.csv", [](RunContext &context) {
+        run_boris(1e-16, context.output);
+    });
+    ensemble.add("boris adaptive", "data/boris_trajectories_adaptive.csv", [](RunContext &context) {
+        run_boris_adaptive(1e-11, {1e8, 0, 0}, context.output);
+    });
+    //Without the electric field only the cyclotron frequency sets the sub-cycling of the electron
+    ensemble.add("boris adaptive pure B", "data/boris_trajectories_adaptive_b.csv", [](RunContext &context) {
+        run_boris_adaptive(1e-11, {0, 0, 0}, context.output);
+    });
+    std::vector<RunResult> results;
+    auto duration = timeIt([&]() { results = ensemble.run(); });
+    EnsembleRunner::printSummary(results, duration);
+    PROFILE_REPORT(duration, "data/boris_profile.json");
+
+    benchmarkPushers(1000000, 20);
+    reportPusherPrecision(1000000, 100);
 }
 
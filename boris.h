@@ -0,0 +1,427 @@
+#ifndef PMPL_BORIS_H
+#define PMPL_BORIS_H
+
+#include <vector>
+#include <cmath>
+#include <map>
+#include <utility>
+#include <algorithm>
+#include "particles.h"
+
+const double vacuumSpeedOfLight = 299792458; //m/s
+
+//Lorentz factor from the norm of relativisticVelocity = gamma * velocity, c in the same units
+double getLorentzFactor(double relativisticSpeed, double speedOfLight) {
+    auto u = relativisticSpeed;
+    return std::sqrt(1 + (u / speedOfLight) * (u / speedOfLight));
+}
+
+//Particles of one species (same mass and charge) stored as a structure of arrays so the pushers vectorize.
+//indices maps the block back to the original std::vector<Particle>.
+//T is the storage of the arrays, float blocks are meant for scaled units, see units.h.
+template<typename T>
+struct BasicParticleBlock {
+    BasicParticleBlock(double mass, double charge, double speedOfLight = vacuumSpeedOfLight) :
+            mass(mass),
+            charge(charge),
+            speedOfLight(speedOfLight) {}
+
+    //The particle has to be in the units of the block, see toScaled
+    void add(const Particle &particle, size_t index) {
+        x.emplace_back(particle.position.x);
+        y.emplace_back(particle.position.y);
+        z.emplace_back(particle.position.z);
+        vx.emplace_back(particle.velocity.x);
+        vy.emplace_back(particle.velocity.y);
+        vz.emplace_back(particle.velocity.z);
+        previousVx.emplace_back(particle.previousVelocity.x);
+        previousVy.emplace_back(particle.previousVelocity.y);
+        previousVz.emplace_back(particle.previousVelocity.z);
+        ux.emplace_back(particle.relativisticVelocity.x);
+        uy.emplace_back(particle.relativisticVelocity.y);
+        uz.emplace_back(particle.relativisticVelocity.z);
+        gamma.emplace_back(getGamma(particle.relativisticVelocity.getNorm()));
+        indices.emplace_back(index);
+    }
+
+    size_t size() const {
+        return indices.size();
+    }
+
+    //Lorentz factor with the speed of light of the block
+    double getGamma(double velocity) const {
+        return getLorentzFactor(velocity, speedOfLight);
+    }
+
+    double mass, charge;
+    double speedOfLight; //in the units of the block
+    std::vector<T> x, y, z;
+    std::vector<T> vx, vy, vz;
+    std::vector<T> previousVx, previousVy, previousVz;
+    std::vector<T> ux, uy, uz; //relativisticVelocity = gamma * velocity
+    std::vector<T> gamma;
+    std::vector<size_t> indices;
+    std::vector<T> rotationFactors; //scratch of borisRelativisticUpdateVelocity, not part of the state
+};
+
+//SI units in double precision, the blocks of the simulations
+using ParticleBlock = BasicParticleBlock<double>;
+
+std::vector<ParticleBlock> splitBySpecies(const std::vector<Particle> &particles) {
+    std::map<std::pair<double, double>, size_t> speciesIndex;
+    std::vector<ParticleBlock> result;
+    for (size_t i = 0; i < particles.size(); i++) {
+        const auto &particle = particles[i];
+        auto species = std::make_pair(particle.mass, particle.charge);
+        auto found = speciesIndex.find(species);
+        if (found == speciesIndex.end()) {
+            found = speciesIndex.emplace(species, result.size()).first;
+            result.emplace_back(ParticleBlock(particle.mass, particle.charge));
+        }
+        result[found->second].add(particle, i);
+    }
+    return result;
+}
+
+void mergeBySpecies(const std::vector<ParticleBlock> &blocks, std::vector<Particle> &particles) {
+    for (const auto &block : blocks) {
+        for (size_t n = 0; n < block.size(); n++) {
+            auto &particle = particles[block.indices[n]];
+            particle.position = {block.x[n], block.y[n], block.z[n]};
+            particle.velocity = {block.vx[n], block.vy[n], block.vz[n]};
+            particle.previousVelocity = {block.previousVx[n], block.previousVy[n], block.previousVz[n]};
+            particle.relativisticVelocity = {block.ux[n], block.uy[n], block.uz[n]};
+        }
+    }
+}
+
+//Reorder the block by the Morton key of the particles, see SpatialSorter. indices still maps every slot to the
+//original particle. Returns the applied order, see radixSortOrder.
+template<typename T>
+std::vector<size_t> sortByMortonKey(BasicParticleBlock<T> &block, Interval sideX, Interval sideY, uint32_t bits = 10) {
+    auto getPosition = [&](size_t k) { return Vector{block.x[k], block.y[k], 0}; };
+    auto order = radixSortOrder(getMortonKeys(block.size(), getPosition, sideX, sideY, bits), 2 * bits);
+    for (auto *array : {&block.x, &block.y, &block.z, &block.vx, &block.vy, &block.vz, &block.previousVx,
+                        &block.previousVy, &block.previousVz, &block.ux, &block.uy, &block.uz, &block.gamma}) {
+        reorder(*array, order);
+    }
+    reorder(block.indices, order);
+    return order;
+}
+
+//Everything in the Boris rotation that depends only on the species, the time step and the (uniform) fields
+struct BorisCoefficients {
+    BorisCoefficients(double charge, double mass, double timeStep, const Vector &E, const Vector &B) :
+            halfStepFactor(charge * timeStep / 2 / mass),
+            b(B.getNorm()),
+            B(B),
+            electricKick(halfStepFactor * E) {
+        auto f1 = b > 0 ? std::tan(halfStepFactor * b) / b : 0;
+        auto f2 = 2 * f1 / (1 + f1 * f1 * (b * b));
+        t = f1 * B;
+        s = f2 * B;
+    }
+
+    double halfStepFactor; //q*dt/2/m
+    double b;
+    Vector B;
+    Vector electricKick; //q*dt/2/m * E
+    Vector t; //f1 * B
+    Vector s; //f2 * B
+};
+
+//Particle by particle Boris push of the velocities in uniform fields
+void borisUpdateVelocity(std::vector<Particle>& particles, double timeStep, const Vector& E, const Vector& B){
+    for (auto& particle : particles){
+        auto q = particle.charge;
+        auto dt = timeStep;
+        auto m = particle.mass;
+        auto b = B.getNorm();
+        auto v1 = particle.velocity + q*dt/2/m*E;
+        auto f1 = std::tan(q*dt/2/m * b) / b;
+        auto v2 = v1 + f1 * (v1.cross(B));
+        auto f2 = 2*f1 / (1 + f1*f1 * (b*b));
+        auto v3 = v1 + f2 * (v2.cross(B));
+
+        particle.previousVelocity = particle.velocity;
+        particle.velocity = v3 + q*dt/2/m*E;
+    }
+}
+
+//Same as borisUpdateVelocity, the coefficients are computed once for the whole block (in double precision)
+template<typename T>
+void borisUpdateVelocity(BasicParticleBlock<T> &block, double timeStep, const Vector &E, const Vector &B) {
+    PROFILE_PHASE("boris push");
+    const BorisCoefficients coefficients(block.charge, block.mass, timeStep, E, B);
+    const T kx = coefficients.electricKick.x, ky = coefficients.electricKick.y, kz = coefficients.electricKick.z;
+    const T tx = coefficients.t.x, ty = coefficients.t.y, tz = coefficients.t.z;
+    const T sx = coefficients.s.x, sy = coefficients.s.y, sz = coefficients.s.z;
+    auto *__restrict vx = block.vx.data();
+    auto *__restrict vy = block.vy.data();
+    auto *__restrict vz = block.vz.data();
+    auto *__restrict previousVx = block.previousVx.data();
+    auto *__restrict previousVy = block.previousVy.data();
+    auto *__restrict previousVz = block.previousVz.data();
+    const auto size = block.size();
+
+    //main routine
+    #pragma omp simd
+    for (size_t n = 0; n < size; n++) {
+        auto v1x = vx[n] + kx, v1y = vy[n] + ky, v1z = vz[n] + kz;
+        auto v2x = v1x + (v1y * tz - v1z * ty);
+        auto v2y = v1y + (v1z * tx - v1x * tz);
+        auto v2z = v1z + (v1x * ty - v1y * tx);
+        auto v3x = v1x + (v2y * sz - v2z * sy);
+        auto v3y = v1y + (v2z * sx - v2x * sz);
+        auto v3z = v1z + (v2x * sy - v2y * sx);
+        previousVx[n] = vx[n];
+        previousVy[n] = vy[n];
+        previousVz[n] = vz[n];
+        vx[n] = v3x + kx;
+        vy[n] = v3y + ky;
+        vz[n] = v3z + kz;
+    }
+}
+
+//Boris push in a uniform B but with the electric field given for each particle (e.g. gathered from a grid)
+template<typename T>
+void borisUpdateVelocity(
+        BasicParticleBlock<T> &block,
+        double timeStep,
+        const std::vector<T> &Ex,
+        const std::vector<T> &Ey,
+        const std::vector<T> &Ez,
+        const Vector &B
+) {
+    PROFILE_PHASE("boris push");
+    const BorisCoefficients coefficients(block.charge, block.mass, timeStep, {0, 0, 0}, B);
+    const T factor = coefficients.halfStepFactor;
+    const T tx = coefficients.t.x, ty = coefficients.t.y, tz = coefficients.t.z;
+    const T sx = coefficients.s.x, sy = coefficients.s.y, sz = coefficients.s.z;
+    auto *__restrict vx = block.vx.data();
+    auto *__restrict vy = block.vy.data();
+    auto *__restrict vz = block.vz.data();
+    auto *__restrict previousVx = block.previousVx.data();
+    auto *__restrict previousVy = block.previousVy.data();
+    auto *__restrict previousVz = block.previousVz.data();
+    const auto *__restrict ex = Ex.data();
+    const auto *__restrict ey = Ey.data();
+    const auto *__restrict ez = Ez.data();
+    const auto size = block.size();
+
+    //main routine
+    #pragma omp simd
+    for (size_t n = 0; n < size; n++) {
+        auto kx = factor * ex[n], ky = factor * ey[n], kz = factor * ez[n];
+        auto v1x = vx[n] + kx, v1y = vy[n] + ky, v1z = vz[n] + kz;
+        auto v2x = v1x + (v1y * tz - v1z * ty);
+        auto v2y = v1y + (v1z * tx - v1x * tz);
+        auto v2z = v1z + (v1x * ty - v1y * tx);
+        auto v3x = v1x + (v2y * sz - v2z * sy);
+        auto v3y = v1y + (v2z * sx - v2x * sz);
+        auto v3z = v1z + (v2x * sy - v2y * sx);
+        previousVx[n] = vx[n];
+        previousVy[n] = vy[n];
+        previousVz[n] = vz[n];
+        vx[n] = v3x + kx;
+        vy[n] = v3y + ky;
+        vz[n] = v3z + kz;
+    }
+}
+
+//Same as borisRelativisticUpdateVelocity, gamma is kept from the previous step instead of being recomputed.
+//The rotation angle depends on gamma of each particle, so the tangents are computed in a separate scalar loop
+//and the rest of the push is vectorized.
+template<typename T>
+void borisRelativisticUpdateVelocity(BasicParticleBlock<T> &block, double timeStep, const Vector &E, const Vector &B) {
+    PROFILE_PHASE("boris push");
+    const BorisCoefficients coefficients(block.charge, block.mass, timeStep, E, B);
+    const T kx = coefficients.electricKick.x, ky = coefficients.electricKick.y, kz = coefficients.electricKick.z;
+    const auto b = coefficients.b;
+    const T b2 = b * b;
+    const T bx = B.x, by = B.y, bz = B.z;
+    const T inverseC2 = 1.0 / (block.speedOfLight * block.speedOfLight);
+    const auto size = block.size();
+
+    //The scratch is kept in the block, only the first push of a block (or of a grown block) allocates
+    auto &f1 = block.rotationFactors;
+    f1.resize(size);
+    for (size_t n = 0; n < size; n++) {
+        f1[n] = b > 0 ? std::tan(coefficients.halfStepFactor / block.gamma[n] * b) / b : 0;
+    }
+
+    auto *__restrict ux = block.ux.data();
+    auto *__restrict uy = block.uy.data();
+    auto *__restrict uz = block.uz.data();
+    auto *__restrict vx = block.vx.data();
+    auto *__restrict vy = block.vy.data();
+    auto *__restrict vz = block.vz.data();
+    auto *__restrict previousVx = block.previousVx.data();
+    auto *__restrict previousVy = block.previousVy.data();
+    auto *__restrict previousVz = block.previousVz.data();
+    auto *__restrict gamma = block.gamma.data();
+    const auto *__restrict factor = f1.data();
+
+    //main routine
+    #pragma omp simd
+    for (size_t n = 0; n < size; n++) {
+        auto f2 = 2 * factor[n] / (1 + factor[n] * factor[n] * b2);
+        auto tx = factor[n] * bx, ty = factor[n] * by, tz = factor[n] * bz;
+        auto sx = f2 * bx, sy = f2 * by, sz = f2 * bz;
+        auto v1x = ux[n] + kx, v1y = uy[n] + ky, v1z = uz[n] + kz;
+        auto v2x = v1x + (v1y * tz - v1z * ty);
+        auto v2y = v1y + (v1z * tx - v1x * tz);
+        auto v2z = v1z + (v1x * ty - v1y * tx);
+        ux[n] = v1x + (v2y * sz - v2z * sy) + kx;
+        uy[n] = v1y + (v2z * sx - v2x * sz) + ky;
+        uz[n] = v1z + (v2x * sy - v2y * sx) + kz;
+        gamma[n] = std::sqrt(1 + (ux[n] * ux[n] + uy[n] * uy[n] + uz[n] * uz[n]) * inverseC2);
+        previousVx[n] = vx[n];
+        previousVy[n] = vy[n];
+        previousVz[n] = vz[n];
+        vx[n] = ux[n] / gamma[n];
+        vy[n] = uy[n] / gamma[n];
+        vz[n] = uz[n] / gamma[n];
+    }
+}
+
+template<typename T>
+void updatePositions(BasicParticleBlock<T> &block, double timeStep) {
+    PROFILE_PHASE("positions");
+    const T dt = timeStep;
+    auto *__restrict x = block.x.data();
+    auto *__restrict y = block.y.data();
+    auto *__restrict z = block.z.data();
+    const auto *__restrict vx = block.vx.data();
+    const auto *__restrict vy = block.vy.data();
+    const auto *__restrict vz = block.vz.data();
+    const auto size = block.size();
+    #pragma omp simd
+    for (size_t n = 0; n < size; n++) {
+        x[n] += dt * vx[n];
+        y[n] += dt * vy[n];
+        z[n] += dt * vz[n];
+    }
+}
+
+//Single particle Boris push in local fields, velocity and then position
+struct BorisPush {
+    void operator()(Particle &particle, double timeStep, const Vector &E, const Vector &B) const {
+        const BorisCoefficients coefficients(particle.charge, particle.mass, timeStep, E, B);
+        auto v1 = particle.velocity + coefficients.electricKick;
+        auto v2 = v1 + v1.cross(coefficients.t);
+        auto v3 = v1 + v2.cross(coefficients.s);
+        particle.previousVelocity = particle.velocity;
+        particle.velocity = v3 + coefficients.electricKick;
+        particle.position += timeStep * particle.velocity;
+    }
+};
+
+//Single particle relativistic Boris push in local fields, see borisRelativisticUpdateVelocity
+struct BorisRelativisticPush {
+    void operator()(Particle &particle, double timeStep, const Vector &E, const Vector &B) const {
+        auto gamma = getLorentzFactor(particle.relativisticVelocity.getNorm(), vacuumSpeedOfLight);
+        const BorisCoefficients coefficients(particle.charge, particle.mass * gamma, timeStep, {0, 0, 0}, B);
+        auto kick = particle.charge * timeStep / 2 / particle.mass * E;
+        auto v1 = particle.relativisticVelocity + kick;
+        auto v2 = v1 + v1.cross(coefficients.t);
+        auto v3 = v1 + v2.cross(coefficients.s);
+        particle.previousVelocity = particle.velocity;
+        particle.relativisticVelocity = v3 + kick;
+        gamma = getLorentzFactor(particle.relativisticVelocity.getNorm(), vacuumSpeedOfLight);
+        particle.velocity = 1 / gamma * particle.relativisticVelocity;
+        particle.position += timeStep * particle.velocity;
+    }
+};
+
+//Block hierarchical time steps, a particle on level l makes 2^l sub-steps of baseTimeStep / 2^l per base step.
+//The level is chosen so that the cyclotron rotation per step stays below maxRotation and the particle moves
+//less than maxGradientStep of the field gradient scale length |F| / |grad F| per step.
+struct AdaptiveTimeStep {
+    double baseTimeStep;
+    int maxLevel = 16;
+    double maxRotation = 0.1;
+    double maxGradientStep = 0.1;
+
+    template<typename ElectricField, typename MagneticField>
+    int getLevel(const Particle &particle, const ElectricField &getE, const MagneticField &getB) const {
+        auto position = particle.position;
+        auto E = getE(position);
+        auto B = getB(position);
+        auto requiredStep = baseTimeStep;
+
+        auto cyclotronFrequency = std::abs(particle.charge) * B.getNorm() / particle.mass;
+        if (cyclotronFrequency > 0) requiredStep = std::min(requiredStep, maxRotation / cyclotronFrequency);
+
+        //Finite difference of the fields along the velocity over the finest step
+        auto speed = particle.velocity.getNorm();
+        if (speed > 0) {
+            auto probe = position + (baseTimeStep / (1 << maxLevel)) * particle.velocity;
+            auto distance = (probe - position).getNorm();
+            //A zero field or a uniform one has an infinite scale length and does not limit the step
+            auto limitByGradient = [&](const Vector &field, const Vector &probeField) {
+                auto difference = (probeField - field).getNorm();
+                if (field.getNorm() == 0 || difference == 0) return;
+                auto scale = field.getNorm() * distance / difference;
+                requiredStep = std::min(requiredStep, maxGradientStep * scale / speed);
+            };
+            limitByGradient(E, getE(probe));
+            limitByGradient(B, getB(probe));
+        }
+
+        //The finest step is the smallest one taken anyway, this keeps log2 finite
+        requiredStep = std::max(requiredStep, baseTimeStep / (1 << maxLevel));
+        auto level = (int) std::ceil(std::log2(baseTimeStep / requiredStep));
+        return std::min(std::max(level, 0), maxLevel);
+    }
+};
+
+//Advance every particle from time by one base step with sub-cycling, the level is reevaluated after each sub-step
+//but a coarser step is only taken when it is aligned to the coarser level, so all particles meet at the base step.
+//Every print time in (time, time + baseTimeStep] is added to the trajectories by linear interpolation
+//between the two sub-steps around it, so the trajectories stay aligned as with updateTrajectories.
+//Returns the number of sub-steps made.
+template<typename Push, typename ElectricField, typename MagneticField>
+long adaptiveBorisStep(
+        std::vector<Particle> &particles,
+        double time,
+        const AdaptiveTimeStep &settings,
+        const ElectricField &getE,
+        const MagneticField &getB,
+        const std::vector<double> &printTimes = {},
+        const Push &push = Push()
+) {
+    const long ticksPerStep = 1L << settings.maxLevel;
+    const double tick = settings.baseTimeStep / ticksPerStep;
+    long subSteps = 0;
+    for (auto &particle : particles) {
+        long elapsed = 0;
+        auto nextPrint = std::upper_bound(printTimes.begin(), printTimes.end(), time);
+        while (elapsed < ticksPerStep) {
+            //main routine
+            //Refine until the step is aligned with the elapsed time, then push with local fields
+            auto level = settings.getLevel(particle, getE, getB);
+            auto ticks = ticksPerStep >> level;
+            while (elapsed % ticks != 0) ticks /= 2;
+            auto stepStart = time + elapsed * tick;
+            auto stepEnd = time + (elapsed + ticks) * tick;
+            auto positionBefore = particle.position;
+            auto velocityBefore = particle.velocity;
+            push(particle, ticks * tick, getE(particle.position), getB(particle.position));
+            elapsed += ticks;
+            subSteps++;
+
+            for (; nextPrint != printTimes.end() && *nextPrint <= stepEnd; ++nextPrint) {
+                auto f = (*nextPrint - stepStart) / (stepEnd - stepStart);
+                auto position = positionBefore + f * (particle.position - positionBefore);
+                auto velocity = velocityBefore + f * (particle.velocity - velocityBefore);
+                particle.trajectory.emplace_back(PhasePoint{
+                        position.x, position.y, position.z, velocity.x, velocity.y, velocity.z, *nextPrint
+                });
+            }
+        }
+    }
+    return subSteps;
+}
+
+#endif //PMPL_BORIS_H
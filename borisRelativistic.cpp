@@ -1,5 +1,8 @@
 #include <chrono>
 #include "particles.h"
+#include "boris.h"
+#include "units.h"
+#include "utils.h"
 
 double getGamma(double velocity) {
     auto c = 299792458;
@@ -29,6 +32,69 @@ borisRelativisticUpdateVelocity(std::vector<Particle> &particles, double timeSte
     }
 }
 
+//Compare the particle by particle pusher with the scaled species blocks,
+//see borisRelativisticUpdateVelocity(BasicParticleBlock<T>&, ...)
+void benchmarkPushers(size_t particleCount, int steps) {
+    const double timeStep = 1e-13;
+    const Vector E = {1e8, 0, 0};
+    const Vector B = {0, 0, 1};
+    auto particles = generateInRectangle(particleCount, {0, 1}, {0, 1}, 9.10938356e-31);
+    for (auto &particle : particles) {
+        particle.charge = 1.60217662e-19;
+        particle.velocity = {0, 1e8, 0};
+        particle.relativisticVelocity = getGamma(particle.velocity.getNorm()) * particle.velocity;
+    }
+    //Every species in its own units stored as Scalar, see units.h
+    std::vector<BasicParticleBlock<Scalar>> blocks;
+    std::vector<UnitSystem> units;
+    for (const auto &block : splitBySpecies(particles)) {
+        units.emplace_back(UnitSystem::forSpecies(block.mass, block.charge, timeStep, 3e-5));
+        blocks.emplace_back(toScaled<Scalar>(block, units.back()));
+    }
+
+    auto particlesDuration = timeIt([&]() {
+        for (int step = 0; step < steps; step++) {
+            borisRelativisticUpdateVelocity(particles, timeStep, E, B);
+            updatePositions(particles, timeStep);
+        }
+    });
+    auto blocksDuration = timeIt([&]() {
+        for (int step = 0; step < steps; step++) {
+            for (size_t k = 0; k < blocks.size(); k++) {
+                auto scaledTimeStep = timeStep / units[k].time;
+                auto scaledE = units[k].scaleElectricField(E), scaledB = units[k].scaleMagneticField(B);
+                borisRelativisticUpdateVelocity(blocks[k], scaledTimeStep, scaledE, scaledB);
+                updatePositions(blocks[k], scaledTimeStep);
+            }
+        }
+    });
+
+    std::cout << "Particle pusher: " << particleCount * steps / particlesDuration << " particles/s" << std::endl;
+    std::cout << "Species block pusher (scaled, " << (sizeof(Scalar) == sizeof(float) ? "float" : "double") << "): "
+              << particleCount * steps / blocksDuration << " particles/s" << std::endl;
+}
+
+//Deviation of the dimensionless double and float pushers from the SI pusher, see reportScaledPrecision
+void reportPusherPrecision(size_t particleCount, int steps) {
+    const double timeStep = 1e-13;
+    const Vector E = {1e8, 0, 0};
+    const Vector B = {0, 0, 1};
+    auto particles = generateInRectangle(particleCount, {0, 1e-3}, {0, 1e-3}, 9.10938356e-31);
+    for (auto &particle : particles) {
+        particle.charge = 1.60217662e-19;
+        particle.velocity = {0, 1e8, 0};
+        particle.relativisticVelocity = getGamma(particle.velocity.getNorm()) * particle.velocity;
+    }
+    auto block = splitBySpecies(particles).front();
+    //Close to the speed of light the electrons move by about 3e-5 m per step
+    auto units = UnitSystem::forSpecies(block.mass, block.charge, timeStep, 3e-5);
+    auto push = [](auto &block, double dt, const Vector &E, const Vector &B) {
+        borisRelativisticUpdateVelocity(block, dt, E, B);
+        updatePositions(block, dt);
+    };
+    reportScaledPrecision(block, units, timeStep, E, B, steps, push);
+}
+
 int main() {
     double time = 0;
     int step = 0;
@@ -67,6 +133,10 @@ int main() {
     auto duration = nanosecondDuration * 1e-9;
 
     std::cout << "Execution took: " << duration << "s." << std::endl;
+    PROFILE_REPORT(duration, "data/boris_relativistic_profile.json");
 
     saveTrajectories("data/boris_relativistic_trajectories.csv", particles);
+
+    benchmarkPushers(1000000, 20);
+    reportPusherPrecision(1000000, 100);
 }
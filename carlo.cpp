@@ -1,131 +1,11 @@
 #include <iostream>
-#include <random>
 #include <cmath>
-#include <algorithm>
-#include <utility>
-#include "utils.h"
+#include <numeric>
+#include <functional>
+#include <string>
 #include <fstream>
-
-struct GridPoint {
-    int i = 0, j = 0;
-};
-
-template <typename T>
-struct Point {
-    T x = 0, y = 0;
-};
-
-enum class Direction {
-    left, right, up, down
-};
-
-template<typename T>
-struct RealInterval {
-    T from = 0, to = 0;
-    T size() const {
-        return to - from;
-    }
-};
-
-using DiscreteInterval = RealInterval<int>;
-
-template<typename T>
-struct RectGrid {
-    RectGrid(int discreteSize, T realSize):
-            RectGrid({0, discreteSize}, {0, discreteSize}, {0, realSize}, {0, realSize}) {}
-
-    RectGrid(
-            const DiscreteInterval &horizontalDiscrete,
-            const DiscreteInterval &verticalDiscrete,
-            const RealInterval<T> &horizontalReal,
-            const RealInterval<T> &verticalReal) :
-            horizontalDiscrete(horizontalDiscrete),
-            verticalDiscrete(verticalDiscrete),
-            horizontalReal(horizontalReal),
-            verticalReal(verticalReal) {}
-
-
-    Point<T> getRealPoint(const GridPoint& discretePoint) const {
-        Point<T> result;
-        result.x = horizontalReal.from + (T) discretePoint.i / (horizontalDiscrete.size() -1) * horizontalReal.size();
-        result.y = verticalReal.from + (T) discretePoint.j / (verticalDiscrete.size() -1) * verticalReal.size();
-        return result;
-    }
-
-    DiscreteInterval horizontalDiscrete, verticalDiscrete;
-    RealInterval<T> horizontalReal, verticalReal;
-};
-
-struct RandomDirection{
-    Direction operator()() const {
-        return (Direction) distribution(generator);
-    }
-
-private:
-    std::random_device randomDevice;
-    mutable std::mt19937 generator{randomDevice()};
-    mutable std::uniform_int_distribution<> distribution{0, 3};
-};
-
-//Randomly add i, j +/- 1 to the current point until a boundary point is found
-template<typename Function>
-GridPoint WanderRandomly(const GridPoint &from, Function isBoundary) {
-    static const RandomDirection getRandomDirection;
-    auto currentPoint = from;
-    while (!isBoundary(currentPoint)) {
-        switch (getRandomDirection()) {
-            case Direction::left:
-                currentPoint.i -= 1;
-                break;
-            case Direction::right:
-                currentPoint.i += 1;
-                break;
-            case Direction::up:
-                currentPoint.j += 1;
-                break;
-            case Direction::down:
-                currentPoint.j -= 1;
-                break;
-            default:
-                throw std::logic_error("Fatal error, no such direction.");
-        }
-    }
-    return currentPoint;
-}
-
-template<typename T>
-struct BoundaryChecker {
-
-    explicit BoundaryChecker(RectGrid<T>  grid): grid(std::move(grid)) {}
-
-    bool operator()(const GridPoint &point) const {
-        return
-                point.i <= grid.horizontalDiscrete.from ||
-                point.i > grid.horizontalDiscrete.to ||
-                point.j <= grid.verticalDiscrete.from ||
-                point.j > grid.verticalDiscrete.to;
-    }
-
-private:
-    RectGrid<T> grid;
-};
-
-
-double boundaryFunction(const Point<double>& point){
-    auto x = point.x;
-    auto y = point.y;
-    return std::exp(-2*x)*std::cos(2*y);
-}
-
-template <typename ForwardIt, typename T>
-void generateCarloValues(ForwardIt first, ForwardIt last, const GridPoint& startPoint, const RectGrid<T>& grid){
-    const BoundaryChecker<T> isBoundary(grid);
-    std::generate(first, last, [&](){
-        auto gridPoint = WanderRandomly(startPoint, isBoundary);
-        auto realPoint = grid.getRealPoint(gridPoint);
-        return boundaryFunction(realPoint);
-    });
-}
+#include "utils.h"
+#include "carlo.h"
 
 struct ScalingTestResult {
     double duration;
@@ -152,6 +32,30 @@ ScalingTestResult scalingTest(int gridSize, int wandersCount = 1000){
     return {duration, potential};
 }
 
+struct VarianceTestResult {
+    double duration;
+    double standardDeviation;
+};
+
+//Repeat the estimate with wandersCount walks and measure the spread of the estimates
+template<typename Generator>
+VarianceTestResult varianceTest(Generator generate, int gridSize, int wandersCount, int repetitions = 100) {
+    RectGrid<double> grid(gridSize, 1.0);
+    const GridPoint startPoint{(gridSize-1)/2, (gridSize-1)/2};
+    std::vector<double> potentials;
+    auto duration = timeIt([&](){
+        std::vector<double> randomBoundaryValues(wandersCount);
+        for (int i = 0; i < repetitions; i++) {
+            generate(randomBoundaryValues.begin(), randomBoundaryValues.end(), startPoint, grid);
+            potentials.emplace_back(std::accumulate(randomBoundaryValues.begin(), randomBoundaryValues.end(), 0.0) / wandersCount);
+        }
+    });
+    auto mean = std::accumulate(potentials.begin(), potentials.end(), 0.0) / repetitions;
+    double variance = 0;
+    for (auto potential : potentials) variance += (potential - mean) * (potential - mean);
+    return {duration / repetitions, std::sqrt(variance / (repetitions - 1))};
+}
+
 int main() {
     std::ofstream file("data/carlo.csv");
     for (int gridSize = 20; gridSize < 202; gridSize=gridSize+2){
@@ -164,5 +68,33 @@ int main() {
         filePrecision << scalingTest(202).potential << std::endl;
     }
 
+    //Compare variance reduction methods, the standard deviation scales as 1/sqrt(walks) so the number of walks
+    //needed for the target error is wandersCount * (standardDeviation / targetError)^2
+    using It = std::vector<double>::iterator;
+    const int gridSize = 102, wandersCount = 1024;
+    const double targetError = 1e-3;
+    const BilinearHarmonic control{0, -2 * std::exp(-1.0) * std::cos(1.0), -2 * std::exp(-1.0) * std::sin(1.0), 0};
+    std::vector<std::pair<std::string, std::function<void(It, It, const GridPoint&, const RectGrid<double>&)>>> methods{
+            {"plain", [](It first, It last, const GridPoint& start, const RectGrid<double>& grid){
+                generateCarloValues(first, last, start, grid);
+            }},
+            {"antithetic", [](It first, It last, const GridPoint& start, const RectGrid<double>& grid){
+                generateAntitheticCarloValues(first, last, start, grid);
+            }},
+            {"control", [&control](It first, It last, const GridPoint& start, const RectGrid<double>& grid){
+                generateControlledCarloValues(first, last, start, grid, control);
+            }},
+            {"stratified", [](It first, It last, const GridPoint& start, const RectGrid<double>& grid){
+                generateStratifiedCarloValues(first, last, start, grid, 2);
+            }}
+    };
+    std::ofstream fileVariance("data/carlo_variance.csv");
+    for (const auto& method : methods) {
+        auto result = varianceTest(method.second, gridSize, wandersCount);
+        auto walksNeeded = wandersCount * std::pow(result.standardDeviation / targetError, 2);
+        fileVariance << method.first << "," << result.standardDeviation << "," << walksNeeded << ","
+                     << result.duration << std::endl;
+    }
+
     return 0;
 }
\ No newline at end of file
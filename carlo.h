@@ -0,0 +1,255 @@
+#ifndef PMPL_CARLO_H
+#define PMPL_CARLO_H
+
+#include <random>
+#include <cmath>
+#include <algorithm>
+#include <numeric>
+#include <utility>
+#include <vector>
+#include <stdexcept>
+
+struct GridPoint {
+    int i = 0, j = 0;
+};
+
+template <typename T>
+struct Point {
+    T x = 0, y = 0;
+};
+
+enum class Direction {
+    left, right, up, down
+};
+
+template<typename T>
+struct RealInterval {
+    T from = 0, to = 0;
+    T size() const {
+        return to - from;
+    }
+};
+
+using DiscreteInterval = RealInterval<int>;
+
+template<typename T>
+struct RectGrid {
+    RectGrid(int discreteSize, T realSize):
+            RectGrid({0, discreteSize}, {0, discreteSize}, {0, realSize}, {0, realSize}) {}
+
+    RectGrid(
+            const DiscreteInterval &horizontalDiscrete,
+            const DiscreteInterval &verticalDiscrete,
+            const RealInterval<T> &horizontalReal,
+            const RealInterval<T> &verticalReal) :
+            horizontalDiscrete(horizontalDiscrete),
+            verticalDiscrete(verticalDiscrete),
+            horizontalReal(horizontalReal),
+            verticalReal(verticalReal) {}
+
+
+    Point<T> getRealPoint(const GridPoint& discretePoint) const {
+        Point<T> result;
+        result.x = horizontalReal.from + (T) discretePoint.i / (horizontalDiscrete.size() -1) * horizontalReal.size();
+        result.y = verticalReal.from + (T) discretePoint.j / (verticalDiscrete.size() -1) * verticalReal.size();
+        return result;
+    }
+
+    DiscreteInterval horizontalDiscrete, verticalDiscrete;
+    RealInterval<T> horizontalReal, verticalReal;
+};
+
+struct RandomDirection{
+    Direction operator()() const {
+        return (Direction) distribution(generator);
+    }
+
+private:
+    std::random_device randomDevice;
+    mutable std::mt19937 generator{randomDevice()};
+    mutable std::uniform_int_distribution<> distribution{0, 3};
+};
+
+void move(GridPoint &point, Direction direction) {
+    switch (direction) {
+        case Direction::left:
+            point.i -= 1;
+            break;
+        case Direction::right:
+            point.i += 1;
+            break;
+        case Direction::up:
+            point.j += 1;
+            break;
+        case Direction::down:
+            point.j -= 1;
+            break;
+        default:
+            throw std::logic_error("Fatal error, no such direction.");
+    }
+}
+
+Direction mirror(Direction direction) {
+    switch (direction) {
+        case Direction::left:
+            return Direction::right;
+        case Direction::right:
+            return Direction::left;
+        case Direction::up:
+            return Direction::down;
+        case Direction::down:
+            return Direction::up;
+        default:
+            throw std::logic_error("Fatal error, no such direction.");
+    }
+}
+
+//Randomly add i, j +/- 1 to the current point until a boundary point is found
+template<typename Function>
+GridPoint WanderRandomly(const GridPoint &from, Function isBoundary) {
+    static thread_local const RandomDirection getRandomDirection;
+    auto currentPoint = from;
+    while (!isBoundary(currentPoint)) {
+        move(currentPoint, getRandomDirection());
+    }
+    return currentPoint;
+}
+
+//Two walkers driven by one direction sequence, the second one taking the mirrored direction.
+//Each of them alone is an ordinary random walk, but their exit points are negatively correlated.
+template<typename Function>
+std::pair<GridPoint, GridPoint> WanderAntithetic(const GridPoint &from, Function isBoundary) {
+    static thread_local const RandomDirection getRandomDirection;
+    auto first = from;
+    auto second = from;
+    while (!isBoundary(first) || !isBoundary(second)) {
+        auto direction = getRandomDirection();
+        if (!isBoundary(first)) move(first, direction);
+        if (!isBoundary(second)) move(second, mirror(direction));
+    }
+    return {first, second};
+}
+
+template<typename T>
+struct BoundaryChecker {
+
+    explicit BoundaryChecker(RectGrid<T>  grid): grid(std::move(grid)) {}
+
+    bool operator()(const GridPoint &point) const {
+        return
+                point.i <= grid.horizontalDiscrete.from ||
+                point.i > grid.horizontalDiscrete.to ||
+                point.j <= grid.verticalDiscrete.from ||
+                point.j > grid.verticalDiscrete.to;
+    }
+
+private:
+    RectGrid<T> grid;
+};
+
+
+double boundaryFunction(const Point<double>& point){
+    auto x = point.x;
+    auto y = point.y;
+    return std::exp(-2*x)*std::cos(2*y);
+}
+
+template <typename ForwardIt, typename T>
+void generateCarloValues(ForwardIt first, ForwardIt last, const GridPoint& startPoint, const RectGrid<T>& grid){
+    const BoundaryChecker<T> isBoundary(grid);
+    std::generate(first, last, [&](){
+        auto gridPoint = WanderRandomly(startPoint, isBoundary);
+        auto realPoint = grid.getRealPoint(gridPoint);
+        return boundaryFunction(realPoint);
+    });
+}
+
+//Same as generateCarloValues but the values are generated in antithetic pairs, see WanderAntithetic.
+//The mean of the values is still the estimate of the potential.
+template <typename ForwardIt, typename T>
+void generateAntitheticCarloValues(ForwardIt first, ForwardIt last, const GridPoint& startPoint, const RectGrid<T>& grid){
+    const BoundaryChecker<T> isBoundary(grid);
+    while (first != last) {
+        auto exitPoints = WanderAntithetic(startPoint, isBoundary);
+        *first++ = boundaryFunction(grid.getRealPoint(exitPoints.first));
+        if (first == last) break;
+        *first++ = boundaryFunction(grid.getRealPoint(exitPoints.second));
+    }
+}
+
+//h(x, y) = a + b*x + c*y + d*x*y is harmonic also on the discrete grid,
+//so its expected value at the exit point is known exactly - it is its value at the start point
+struct BilinearHarmonic {
+    double a = 0, b = 0, c = 0, d = 0;
+
+    double operator()(const Point<double>& point) const {
+        return a + b * point.x + c * point.y + d * point.x * point.y;
+    }
+};
+
+//Control variate estimator, each value is f - beta * (h - E[h]) where beta = cov(f, h) / var(h) is
+//estimated from the same walks. The mean of the values is the estimate of the potential.
+template <typename ForwardIt, typename T, typename Harmonic>
+void generateControlledCarloValues(
+        ForwardIt first,
+        ForwardIt last,
+        const GridPoint& startPoint,
+        const RectGrid<T>& grid,
+        const Harmonic& control
+){
+    const BoundaryChecker<T> isBoundary(grid);
+    std::vector<double> controlValues;
+    for (auto it = first; it != last; ++it) {
+        auto realPoint = grid.getRealPoint(WanderRandomly(startPoint, isBoundary));
+        *it = boundaryFunction(realPoint);
+        controlValues.emplace_back(control(realPoint));
+    }
+    if (controlValues.size() < 2) return;
+
+    auto count = (double) controlValues.size();
+    auto valuesMean = std::accumulate(first, last, 0.0) / count;
+    auto controlMean = std::accumulate(controlValues.begin(), controlValues.end(), 0.0) / count;
+    double covariance = 0, variance = 0;
+    auto it = first;
+    for (auto controlValue : controlValues) {
+        covariance += (*it++ - valuesMean) * (controlValue - controlMean);
+        variance += (controlValue - controlMean) * (controlValue - controlMean);
+    }
+    if (variance == 0) return;
+
+    auto beta = covariance / variance;
+    auto expected = control(grid.getRealPoint(startPoint));
+    it = first;
+    for (auto controlValue : controlValues) {
+        *it++ -= beta * (controlValue - expected);
+    }
+}
+
+//Stratify the first stratifiedSteps steps - all 4^stratifiedSteps direction prefixes are used equally often
+//and the rest of the walk is random. The mean of the values is the stratified estimate of the potential
+//if the number of values is a multiple of 4^stratifiedSteps.
+template <typename ForwardIt, typename T>
+void generateStratifiedCarloValues(
+        ForwardIt first,
+        ForwardIt last,
+        const GridPoint& startPoint,
+        const RectGrid<T>& grid,
+        int stratifiedSteps = 2
+){
+    const BoundaryChecker<T> isBoundary(grid);
+    const int strataCount = 1 << (2 * stratifiedSteps);
+    int stratum = 0;
+    std::generate(first, last, [&](){
+        auto currentPoint = startPoint;
+        auto prefix = stratum;
+        for (int step = 0; step < stratifiedSteps && !isBoundary(currentPoint); step++) {
+            move(currentPoint, (Direction) (prefix % 4));
+            prefix /= 4;
+        }
+        stratum = (stratum + 1) % strataCount;
+        auto gridPoint = WanderRandomly(currentPoint, isBoundary);
+        return boundaryFunction(grid.getRealPoint(gridPoint));
+    });
+}
+
+#endif //PMPL_CARLO_H
@@ -0,0 +1,152 @@
+#ifndef PMPL_CHECKPOINT_H
+#define PMPL_CHECKPOINT_H
+
+#include <string>
+#include <vector>
+#include <fstream>
+#include <sstream>
+#include <cstdio>
+#include <cstdint>
+#include <stdexcept>
+#include <type_traits>
+#include <unistd.h>
+#include "particles.h"
+
+const uint64_t checkpointMagic = 0x314b43504c504d50; //"PMPLPCK1"
+
+//Binary snapshot of a run. Values are read back in the order they were written, plain values and vectors of them
+//are raw bytes so a snapshot only has to be read by the same build on the same machine.
+//The snapshot is written to filename.tmp and renamed over filename by commit, so a run killed while writing
+//still leaves the previous snapshot intact.
+class CheckpointWriter {
+public:
+    explicit CheckpointWriter(const std::string &filename) :
+            filename(filename),
+            file(filename + ".tmp", std::ios::binary) {
+        write(checkpointMagic);
+    }
+
+    template<typename T>
+    void write(const T &value) {
+        static_assert(std::is_trivially_copyable<T>::value, "Only plain values can be written as raw bytes.");
+        file.write(reinterpret_cast<const char *>(&value), sizeof(T));
+    }
+
+    template<typename T>
+    void write(const std::vector<T> &values) {
+        static_assert(std::is_trivially_copyable<T>::value, "Only plain values can be written as raw bytes.");
+        write((uint64_t) values.size());
+        file.write(reinterpret_cast<const char *>(values.data()), values.size() * sizeof(T));
+    }
+
+    void write(const std::string &value) {
+        write(std::vector<char>(value.begin(), value.end()));
+    }
+
+    void write(const std::vector<Particle> &particles) {
+        write((uint64_t) particles.size());
+        for (const auto &particle : particles) {
+            write(particle.force);
+            write(particle.position);
+            write(particle.velocity);
+            write(particle.previousVelocity);
+            write(particle.relativisticVelocity);
+            write(particle.mass);
+            write(particle.charge);
+            write(particle.nextCollisionTime);
+            write(particle.trajectory);
+        }
+    }
+
+    //see getRandomEngine
+    void writeRandomState() {
+        std::ostringstream state;
+        state << getRandomEngine();
+        write(state.str());
+    }
+
+    void commit() {
+        file.close();
+        if (!file || std::rename((filename + ".tmp").c_str(), filename.c_str()) != 0) {
+            throw std::runtime_error("Cannot write checkpoint " + filename);
+        }
+    }
+
+private:
+    std::string filename;
+    std::ofstream file;
+};
+
+class CheckpointReader {
+public:
+    explicit CheckpointReader(const std::string &filename) : file(filename, std::ios::binary) {
+        if (!file) throw std::runtime_error("Cannot open checkpoint " + filename);
+        uint64_t magic = 0;
+        read(magic);
+        if (magic != checkpointMagic) throw std::runtime_error("Not a checkpoint " + filename);
+    }
+
+    template<typename T>
+    void read(T &value) {
+        static_assert(std::is_trivially_copyable<T>::value, "Only plain values can be read as raw bytes.");
+        file.read(reinterpret_cast<char *>(&value), sizeof(T));
+        check();
+    }
+
+    template<typename T>
+    void read(std::vector<T> &values) {
+        static_assert(std::is_trivially_copyable<T>::value, "Only plain values can be read as raw bytes.");
+        uint64_t size = 0;
+        read(size);
+        values.resize(size);
+        file.read(reinterpret_cast<char *>(values.data()), size * sizeof(T));
+        check();
+    }
+
+    void read(std::string &value) {
+        std::vector<char> characters;
+        read(characters);
+        value.assign(characters.begin(), characters.end());
+    }
+
+    void read(std::vector<Particle> &particles) {
+        uint64_t size = 0;
+        read(size);
+        particles.assign(size, Particle(0, {0, 0, 0}, {0, 0, 0}));
+        for (auto &particle : particles) {
+            read(particle.force);
+            read(particle.position);
+            read(particle.velocity);
+            read(particle.previousVelocity);
+            read(particle.relativisticVelocity);
+            read(particle.mass);
+            read(particle.charge);
+            read(particle.nextCollisionTime);
+            read(particle.trajectory);
+        }
+    }
+
+    void readRandomState() {
+        std::string state;
+        read(state);
+        std::istringstream stream(state);
+        stream >> getRandomEngine();
+    }
+
+private:
+    std::ifstream file;
+
+    void check() {
+        if (!file) throw std::runtime_error("Checkpoint is truncated");
+    }
+};
+
+//Cut an output file back to the size it had when the checkpoint was written, so a restarted run appends exactly
+//the lines the killed run would have written
+void truncateOutput(const std::string &filename, uint64_t size) {
+    if (truncate(filename.c_str(), (off_t) size) != 0) {
+        throw std::runtime_error("Cannot truncate " + filename);
+    }
+}
+
+#endif //PMPL_CHECKPOINT_H
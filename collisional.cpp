@@ -1,12 +1,19 @@
 #include "particles.h"
+#include "checkpoint.h"
 
 #include <iostream>
 #include <vector>
 #include <cmath>
 #include <limits>
 #include <chrono>
+#include <string>
 #include <fenv.h>
 
+//Usage: Collisional [restart] [interactions] [cross_sections.csv]
+//A snapshot is written every checkpointAfterSteps steps, restart continues from the last one
+//Without a cross section table the collision frequency is constant, see CollisionTable::load for the format
+//interactions adds the screened Coulomb force between the electrons closer than cutoff, see CellList.
+//A restart has to be given the same arguments as the run it continues.
 int main(int argc, char *argv[]) {
     feenableexcept(FE_INVALID | FE_OVERFLOW);
 
@@ -18,37 +25,106 @@ int main(int argc, char *argv[]) {
     auto steps = (int) std::round(finalTime / timeStep);
     int printAfterSteps = steps / printCount;
     double backgroundParticleMass = 6.63352088e-26;
-    double maxCollisionFrequency = 1e7;
+    double collisionFrequency = 0.5e7;
+    double backgroundDensity = 1e20; //only used with a cross section table
+    size_t particleCount = 1000;
+    const double electronCharge = -1.60217662e-19;
+    //About 30 partners per electron whatever the particle count, the force is screened at a third of the cutoff
+    const double cutoff = std::sqrt(30 / (M_PI * particleCount));
+    int sortAfterSteps = 10; //has to divide checkpointAfterSteps, see SpatialSorter
+    int checkpointAfterSteps = 100000;
+    const std::string checkpointFilename = "data/collisional_checkpoint.bin";
+    const std::string energyFilename = "data/collisional_energy.csv";
+    const std::string sideSpeedsFilename = "data/collisional_side_speeds.csv";
+    std::vector<std::string> arguments(argv + 1, argv + argc);
+    bool restart = false, interactions = false;
+    std::string tableFilename;
+    for (const auto &argument : arguments) {
+        if (argument == "restart") restart = true;
+        else if (argument == "interactions") interactions = true;
+        else tableFilename = argument;
+    }
 
     const Interval side{0, 1};
-    std::vector<Particle> particles = generateInRectangle(
-            1000,
-            side,
-            side,
-            9.10938356e-31 //mass of electron
-    );
-
-    //main routine
-    //Sample the velocities from Maxwell distribution
-    //See setThermalVelocities in particles.h
-    setThermalVelocities(particles, 11600);
-    initCollisionTimes(particles, maxCollisionFrequency);
-
-    std::ofstream energyFile("data/collisional_energy.csv");
-    energyFile.precision(std::numeric_limits<double>::max_digits10);
+    const double electronMass = 9.10938356e-31;
+    //The interactions change the speed between the collisions, the speed bands of the majorant are then not valid
+    auto collisionTable = tableFilename.empty()
+                          ? CollisionTable::constant(collisionFrequency)
+                          : CollisionTable::load(tableFilename, electronMass, backgroundDensity, 4096,
+                                                 interactions ? 1 : 16);
+    std::vector<Particle> particles;
+    double initialEnergy = 0;
+    //Every 100th particle is recorded for the animation, see TracerRecorder
+    TracerRecorder tracers(TracerRecorder::selectEvenly(particleCount, 10), steps / printAfterSteps + 2);
+    CellList cells(side, side, cutoff);
+    ScreenedCoulombLaw coulomb{cutoff / 3};
+    //Particles close in the box are kept close in memory, the cell list cost per particle then does not grow with N
+    SpatialSorter sorter(side, side, sortAfterSteps);
+
+    if (restart) {
+        //Time, step, particles with their collision clocks, tracers, the random engine and the sizes of the outputs
+        CheckpointReader checkpoint(checkpointFilename);
+        checkpoint.read(time);
+        checkpoint.read(step);
+        checkpoint.read(initialEnergy);
+        checkpoint.read(particles);
+        checkpoint.read(tracers.getPoints());
+        checkpoint.read(tracers.getIndices());
+        checkpoint.readRandomState();
+        for (const auto &filename : {energyFilename, sideSpeedsFilename}) {
+            uint64_t size = 0;
+            checkpoint.read(size);
+            truncateOutput(filename, size);
+        }
+    } else {
+        particles = generateInRectangle(
+                particleCount,
+                side,
+                side,
+                electronMass
+        );
 
-    auto start = std::chrono::high_resolution_clock::now();
+        //main routine
+        //Sample the velocities from Maxwell distribution
+        //See setThermalVelocities in particles.h
+        setThermalVelocities(particles, 11600);
+        initCollisionTimes(particles, collisionTable);
+        for (auto &particle : particles) particle.charge = electronCharge;
+        initialEnergy = getTotalKineticEnergy(particles);
+    }
+    clearTrajectories(particles);
 
-    auto initialEnergy = getTotalKineticEnergy(particles);
-    SideSampler sideSampler;
+    //Formatting and disk writes happen on the writer thread, see DiagnosticsWriter
+    DiagnosticsWriter writer;
+    auto energyStream = writer.open(energyFilename, std::numeric_limits<double>::max_digits10, restart);
+    auto sideSpeedsStream = writer.open(sideSpeedsFilename, 6, restart);
+    SideSampler sideSampler(writer, sideSpeedsStream);
+
+    auto start = std::chrono::high_resolution_clock::now();
 
     while (time < finalTime) {
+        if (interactions) {
+            //The cells are rebuilt after every sort, so a restart (at a multiple of sortAfterSteps) sums the forces
+            //in the same order as the run it continues
+            if (sorter.sort(particles, step)) {
+                tracers.reorder(sorter.getOrder());
+                cells.invalidate();
+            }
+
+            //main routine
+            //Short range forces between the electrons, see CellList::updateForces
+            setAllForces(particles, {0, 0});
+            cells.updateForces(particles, coulomb);
+            //Unlike updateVelocities the previous velocity is kept, so getTotalKineticEnergy measures the same
+            //as in the runs without interactions
+            for (auto &particle : particles) particle.velocity += timeStep * particle.getAcceleration();
+        }
         updatePositions(particles, timeStep);
 
         //main routine
         //Apply collisions
         //see collide in particles.h
-        collide(particles, backgroundParticleMass, time, maxCollisionFrequency, [](double speed){return 0.5e7;});
+        collide(particles, backgroundParticleMass, time, collisionTable);
 
         sideSampler.sample(particles, side);
 
@@ -58,13 +134,28 @@ int main(int argc, char *argv[]) {
         applyPeriodicBorderCondition(particles, side, side);
 
         if (step % printAfterSteps == 0) {
-            updateTrajectories(particles, time);
+            tracers.record(particles, time);
             auto totalEnergy = getTotalKineticEnergy(particles);
-            energyFile << time << "," << (totalEnergy - initialEnergy) / totalEnergy << std::endl;
+            writer.write(energyStream, {time, (totalEnergy - initialEnergy) / totalEnergy});
         }
 
         time += timeStep;
         step++;
+
+        if (step % checkpointAfterSteps == 0) {
+            CheckpointWriter checkpoint(checkpointFilename);
+            checkpoint.write(time);
+            checkpoint.write(step);
+            checkpoint.write(initialEnergy);
+            checkpoint.write(particles);
+            checkpoint.write(tracers.getPoints());
+            checkpoint.write(tracers.getIndices());
+            checkpoint.writeRandomState();
+            for (auto stream : {energyStream, sideSpeedsStream}) {
+                checkpoint.write(writer.getSize(stream));
+            }
+            checkpoint.commit();
+        }
     }
 
     auto end = std::chrono::high_resolution_clock::now();
@@ -72,6 +163,8 @@ int main(int argc, char *argv[]) {
     auto duration = nanosecondDuration * 1e-9;
 
     std::cout << "Execution took: " << duration << "s." << std::endl;
+    PROFILE_REPORT(duration, "data/collisional_profile.json");
 
-    saveTrajectories("data/collisional_trajectories.csv", particles);
+    tracers.save("data/collisional_trajectories.csv");
+    saveVelocities("data/collisional_velocities.csv", particles);
 }
@@ -28,13 +28,18 @@ int main(int argc, char *argv[]) {
     //See setThermalVelocities in particles.h
     setThermalVelocities(particles, 11600);
 
-    std::ofstream energyFile("data/collisionless_energy.csv");
-    energyFile.precision(std::numeric_limits<double>::max_digits10);
+    //Only 100 tracers are recorded for the animation, see TracerRecorder
+    TracerRecorder tracers(TracerRecorder::selectEvenly(particles.size(), 100), steps / printAfterSteps + 2);
+    clearTrajectories(particles);
+
+    //Formatting and disk writes happen on the writer thread, see DiagnosticsWriter
+    DiagnosticsWriter writer;
+    auto energyStream = writer.open("data/collisionless_energy.csv", std::numeric_limits<double>::max_digits10);
 
     auto start = std::chrono::high_resolution_clock::now();
 
     auto initialEnergy = getTotalKineticEnergy(particles);
-    SideSampler sideSampler;
+    SideSampler sideSampler(writer, writer.open("data/collisionless_side_speeds.csv"));
 
     while (time < finalTime) {
 
@@ -50,9 +55,9 @@ int main(int argc, char *argv[]) {
         applyPeriodicBorderCondition(particles, side, side);
 
         if (step % printAfterSteps == 0) {
-            updateTrajectories(particles, time);
+            tracers.record(particles, time);
             auto totalEnergy = getTotalKineticEnergy(particles);
-            energyFile << time << "," << (totalEnergy - initialEnergy) / totalEnergy << std::endl;
+            writer.write(energyStream, {time, (totalEnergy - initialEnergy) / totalEnergy});
         }
 
         time += timeStep;
@@ -64,7 +69,8 @@ int main(int argc, char *argv[]) {
     auto duration = nanosecondDuration * 1e-9;
 
     std::cout << "Execution took: " << duration << "s." << std::endl;
+    PROFILE_REPORT(duration, "data/collisionless_profile.json");
 
-    saveTrajectories("data/collisionless_trajectories.csv", particles);
-    sideSampler.save("data/collisionless_side_speeds.csv");
+    tracers.save("data/collisionless_trajectories.csv");
+    saveVelocities("data/collisionless_velocities.csv", particles);
 }
@@ -0,0 +1,134 @@
+#ifndef PMPL_DIAGNOSTICS_H
+#define PMPL_DIAGNOSTICS_H
+
+#include <string>
+#include <vector>
+#include <memory>
+#include <fstream>
+#include <thread>
+#include <mutex>
+#include <condition_variable>
+#include <initializer_list>
+#include <cstdint>
+#include <cstdio>
+
+//CSV outputs written by a background thread. The time loop only copies the raw values of a record into the front
+//buffer, the writer thread swaps it with the back buffer and formats and writes the back buffer to the files.
+//Memory is bounded by the two buffers: if the disk cannot keep up, write waits until the writer frees the front buffer.
+class DiagnosticsWriter {
+public:
+    //bufferSize is the number of values of one buffer
+    explicit DiagnosticsWriter(size_t bufferSize = 1 << 20) : bufferSize(bufferSize) {
+        front.reserve(bufferSize);
+        back.reserve(bufferSize);
+        thread = std::thread([this]() { run(); });
+    }
+
+    DiagnosticsWriter(const DiagnosticsWriter &) = delete;
+
+    DiagnosticsWriter &operator=(const DiagnosticsWriter &) = delete;
+
+    ~DiagnosticsWriter() {
+        {
+            std::lock_guard<std::mutex> lock(mutex);
+            stopping = true;
+        }
+        hasData.notify_one();
+        thread.join();
+    }
+
+    //Returns the stream index for write, the values are written with the given number of significant digits
+    size_t open(const std::string &filename, int precision = 6, bool append = false) {
+        sync();
+        std::lock_guard<std::mutex> lock(mutex);
+        files.emplace_back(new std::ofstream(filename, append ? std::ios::app : std::ios::trunc));
+        files.back()->precision(precision);
+        return files.size() - 1;
+    }
+
+    //count values of the stream as lines of rowLength comma separated values, by default one line
+    void write(size_t stream, const double *values, size_t count, size_t rowLength = 0) {
+        if (count == 0) return;
+        if (rowLength == 0) rowLength = count;
+        std::unique_lock<std::mutex> lock(mutex);
+        //A record larger than the buffer is still accepted into an empty buffer
+        hasSpace.wait(lock, [&]() { return front.size() + count + 3 <= bufferSize || front.empty(); });
+        front.emplace_back(stream);
+        front.emplace_back(count);
+        front.emplace_back(rowLength);
+        front.insert(front.end(), values, values + count);
+        lock.unlock();
+        hasData.notify_one();
+    }
+
+    void write(size_t stream, std::initializer_list<double> values) {
+        write(stream, values.begin(), values.size());
+    }
+
+    //Wait until everything written so far is formatted and flushed to the files
+    void sync() {
+        std::unique_lock<std::mutex> lock(mutex);
+        hasSpace.wait(lock, [&]() { return front.empty() && !busy; });
+        for (auto &file : files) file->flush();
+    }
+
+    //Size of the stream file in bytes, e.g. to cut it back on restart
+    uint64_t getSize(size_t stream) {
+        sync();
+        std::lock_guard<std::mutex> lock(mutex);
+        return (uint64_t) files[stream]->tellp();
+    }
+
+private:
+    size_t bufferSize;
+    //Records are stored as stream, count, rowLength and count values
+    std::vector<double> front, back;
+    std::vector<std::unique_ptr<std::ofstream>> files;
+    std::mutex mutex;
+    std::condition_variable hasData, hasSpace;
+    bool busy = false, stopping = false;
+    std::thread thread;
+
+    void run() {
+        std::unique_lock<std::mutex> lock(mutex);
+        while (true) {
+            hasData.wait(lock, [&]() { return !front.empty() || stopping; });
+            if (front.empty()) break;
+            std::swap(front, back);
+            busy = true;
+            lock.unlock();
+            hasSpace.notify_all();
+
+            format();
+            back.clear();
+
+            lock.lock();
+            busy = false;
+            hasSpace.notify_all();
+        }
+    }
+
+    //Same output as file << value with the file precision, but snprintf into one buffer is several times faster
+    void format() {
+        size_t position = 0;
+        std::string text;
+        char number[32];
+        while (position < back.size()) {
+            auto &file = *files[(size_t) back[position]];
+            auto count = (size_t) back[position + 1];
+            auto rowLength = (size_t) back[position + 2];
+            auto precision = (int) file.precision();
+            position += 3;
+            text.clear();
+            for (size_t i = 0; i < count; i++) {
+                auto length = std::snprintf(number, sizeof(number), "%.*g", precision, back[position + i]);
+                text.append(number, length);
+                text += (i + 1) % rowLength ? ',' : '\n';
+            }
+            file.write(text.data(), text.size());
+            position += count;
+        }
+    }
+};
+
+#endif //PMPL_DIAGNOSTICS_H
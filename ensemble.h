@@ -0,0 +1,132 @@
+#ifndef PMPL_ENSEMBLE_H
+#define PMPL_ENSEMBLE_H
+
+#include <string>
+#include <vector>
+#include <map>
+#include <functional>
+#include <thread>
+#include <atomic>
+#include <memory>
+#include <random>
+#include <sstream>
+#include <fstream>
+#include <iostream>
+#include <algorithm>
+#include <exception>
+#include "utils.h"
+
+//What one simulation instance gets from the runner, the seed depends only on the ensemble seed and the run index
+struct RunContext {
+    size_t index;
+    uint32_t seed;
+    std::ostream &output;
+};
+
+struct RunResult {
+    std::string configuration;
+    std::string output; //empty if the run was streamed to a file
+    double duration;
+    std::string error; //what() of the exception that ended the run, empty if it finished
+};
+
+//Runs independent simulations on a pool of threads. Every run streams to its own sink - a file if the file name
+//is given or a buffer returned in RunResult::output otherwise. The results are in the order of add.
+//An exception thrown by a run ends only that run, it is reported in RunResult::error.
+class EnsembleRunner {
+public:
+    explicit EnsembleRunner(uint32_t seed = 0, unsigned threadCount = std::thread::hardware_concurrency()) :
+            seed(seed), threadCount(std::max(1u, threadCount)) {}
+
+    void add(const std::string &configuration, const std::string &filename, std::function<void(RunContext &)> run) {
+        runs.emplace_back(Run{configuration, filename, std::move(run)});
+    }
+
+    //Number of runs added since the last run
+    size_t size() const {
+        return runs.size();
+    }
+
+    std::vector<RunResult> run() {
+        std::vector<RunResult> results(runs.size());
+        std::atomic<size_t> next{0};
+        auto worker = [&]() {
+            for (auto index = next++; index < runs.size(); index = next++) {
+                //main routine
+                //see execute
+                results[index] = execute(index);
+            }
+        };
+        std::vector<std::thread> threads;
+        for (unsigned i = 1; i < threadCount; i++) threads.emplace_back(worker);
+        worker();
+        for (auto &thread : threads) thread.join();
+        runs.clear();
+        return results;
+    }
+
+    //Runs count, summed run time and throughput for each configuration, then the failed runs
+    static void printSummary(const std::vector<RunResult> &results, double wallTime, std::ostream &os = std::cout) {
+        std::map<std::string, std::pair<int, double>> configurations;
+        for (const auto &result : results) {
+            configurations[result.configuration].first++;
+            configurations[result.configuration].second += result.duration;
+        }
+        for (const auto &configuration : configurations) {
+            auto count = configuration.second.first;
+            auto duration = configuration.second.second;
+            os << configuration.first << ": " << count << " runs, " << duration << "s, "
+               << count / duration << " runs/s of run time" << std::endl;
+        }
+        os << "Ensemble wall time: " << wallTime << "s, " << results.size() / wallTime << " runs/s" << std::endl;
+        for (size_t index = 0; index < results.size(); index++) {
+            if (!results[index].error.empty()) {
+                os << "Run " << index << " (" << results[index].configuration << ") failed: " << results[index].error
+                   << std::endl;
+            }
+        }
+    }
+
+private:
+    struct Run {
+        std::string configuration;
+        std::string filename;
+        std::function<void(RunContext &)> function;
+    };
+
+    uint32_t seed;
+    unsigned threadCount;
+    std::vector<Run> runs;
+
+    RunResult execute(size_t index) {
+        const auto &run = runs[index];
+        std::seed_seq seeds{seed, (uint32_t) index};
+        uint32_t runSeed;
+        seeds.generate(&runSeed, &runSeed + 1);
+
+        std::unique_ptr<std::ostream> sink;
+        if (run.filename.empty()) {
+            sink.reset(new std::ostringstream());
+        } else {
+            sink.reset(new std::ofstream(run.filename));
+        }
+        RunContext context{index, runSeed, *sink};
+        std::string error;
+        auto duration = timeIt([&]() {
+            //Escaping the worker thread would call std::terminate and take all the other runs with it
+            try {
+                run.function(context);
+            } catch (const std::exception &exception) {
+                error = exception.what();
+            } catch (...) {
+                error = "unknown exception";
+            }
+        });
+
+        RunResult result{run.configuration, "", duration, error};
+        if (run.filename.empty()) result.output = static_cast<std::ostringstream &>(*sink).str();
+        return result;
+    }
+};
+
+#endif //PMPL_ENSEMBLE_H
@@ -0,0 +1,166 @@
+#include <iostream>
+#include <fstream>
+#include <cmath>
+#include <vector>
+#include "utils.h"
+#include "carlo.h"
+#include "sor.h"
+
+//Sub-window of the full grid given by its corner nodes (inclusive)
+struct Window {
+    uint fromI, fromJ, toI, toJ;
+
+    uint sizeX() const {
+        return toI - fromI + 1;
+    }
+
+    uint sizeY() const {
+        return toJ - fromJ + 1;
+    }
+};
+
+//Monte Carlo estimate of the potential at a single node of the full grid with gridSize x gridSize nodes
+double estimatePotential(const GridPoint &point, uint gridSize, const RectGrid<double> &grid, int wandersCount) {
+    auto isBoundary = [gridSize](const GridPoint &point) {
+        return isBorder({(uint) point.i, (uint) point.j}, gridSize);
+    };
+    double sum = 0;
+    for (int n = 0; n < wandersCount; n += 2) {
+        auto exitPoints = WanderAntithetic(point, isBoundary);
+        sum += boundaryFunction(grid.getRealPoint(exitPoints.first));
+        sum += boundaryFunction(grid.getRealPoint(exitPoints.second));
+    }
+    return sum / (2 * ((wandersCount + 1) / 2));
+}
+
+//Set the window border by Monte Carlo walks on the full grid (in parallel, each border node is independent)
+//and solve the window interior by SOR, see estimatePotential and sor
+SorResult<double> hybridSolve(uint gridSize, const Window &window, int wandersCount, double omega) {
+    const RectGrid<double> grid((int) gridSize, 1.0);
+    const double step = 1.0 / (gridSize - 1);
+
+    std::vector<Index2D> borderNodes;
+    for (uint i = 0; i < window.sizeX(); i++) {
+        for (uint j = 0; j < window.sizeY(); j++) {
+            if (i == 0 || j == 0 || i == window.sizeX() - 1 || j == window.sizeY() - 1) {
+                borderNodes.emplace_back(Index2D{i, j});
+            }
+        }
+    }
+
+    Vector2D<double> phi(window.sizeX(), window.sizeY());
+    Vector2D<double> r(window.sizeX(), window.sizeY());
+
+    //main routine
+    //Border values from random walks, nodes on the border of the full grid are known directly
+    #pragma omp parallel for schedule(dynamic)
+    for (long n = 0; n < (long) borderNodes.size(); n++) {
+        auto local = borderNodes[n];
+        GridPoint global{(int) (window.fromI + local.i), (int) (window.fromJ + local.j)};
+        if (isBorder({(uint) global.i, (uint) global.j}, gridSize)) {
+            phi[local] = boundaryFunction(grid.getRealPoint(global));
+        } else {
+            phi[local] = estimatePotential(global, gridSize, grid, wandersCount);
+        }
+    }
+
+    //main routine
+    //Interior of the window by the ordinary SOR
+    auto result = sor(step, omega, phi, r);
+
+    //sor compares with the analytic function at the window indices, the window starts at (fromI, fromJ)
+    result.norm = 0;
+    for (uint i = 1; i < window.sizeX() - 1; i++) {
+        for (uint j = 1; j < window.sizeY() - 1; j++) {
+            auto exact = analyticFunction((window.fromI + i) * step, (window.fromJ + j) * step);
+            result.norm += std::abs(result.function[{i, j}] - exact) * step * step;
+        }
+    }
+    return result;
+}
+
+struct HybridComparison {
+    double hybridDuration, hybridError;
+    double fullDuration, fullError;
+    SorResult<double> hybridResult;
+};
+
+//Hybrid solve of the window against SOR on the full grid, l1 errors in the window against the analytic function
+HybridComparison compare(uint gridSize, const Window &window, int wandersCount) {
+    const double step = 1.0 / (gridSize - 1);
+    HybridComparison result{};
+    result.hybridDuration = timeIt([&]() {
+        result.hybridResult = hybridSolve(gridSize, window, wandersCount, 1.84);
+    });
+    for (uint i = 0; i < window.sizeX(); i++) {
+        for (uint j = 0; j < window.sizeY(); j++) {
+            auto phi = result.hybridResult.function[{i, j}];
+            auto exact = analyticFunction((window.fromI + i) * step, (window.fromJ + j) * step);
+            result.hybridError += std::abs(phi - exact) * step * step;
+        }
+    }
+
+    //Reference - SOR on the full grid with the optimal omega of the grid
+    Vector2D<double> phi(gridSize);
+    Vector2D<double> r(gridSize);
+    for (uint i = 0; i < gridSize; i++) {
+        for (uint j = 0; j < gridSize; j++) {
+            if (isBorder({i, j}, gridSize)) {
+                phi[{i, j}] = analyticFunction(i * step, j * step);
+            }
+        }
+    }
+    const double omega = 2 / (1 + std::sin(M_PI / (gridSize - 1)));
+    SorResult<double> fullResult;
+    result.fullDuration = timeIt([&]() {
+        fullResult = sor(step, omega, std::move(phi), r);
+    });
+    for (uint i = window.fromI; i <= window.toI; i++) {
+        for (uint j = window.fromJ; j <= window.toJ; j++) {
+            auto exact = analyticFunction(i * step, j * step);
+            result.fullError += std::abs(fullResult.function[{i, j}] - exact) * step * step;
+        }
+    }
+    return result;
+}
+
+//A fixed window in the middle of growing grids. The walks cost about N^2 steps per border node and the full SOR
+//about N^3 updates, so the hybrid gets cheaper relative to the full SOR as 1/N. With 4 * 11 border nodes and
+//100 walks per node it wins from N of about 600.
+//data/hybrid_scaling.csv: gridSize,hybridDuration,hybridError,fullDuration,fullError
+//data/hybrid.csv: x,y,phi of the window of the largest grid
+int main() {
+    const uint windowSize = 11;
+    const int wandersCount = 100;
+    std::ofstream scalingFile("data/hybrid_scaling.csv");
+    HybridComparison comparison;
+    Window window{};
+    uint gridSize = 0, crossover = 0;
+    for (uint size : {101u, 201u, 401u, 801u}) {
+        gridSize = size;
+        auto from = (gridSize - windowSize) / 2;
+        window = {from, from, from + windowSize - 1, from + windowSize - 1};
+        comparison = compare(gridSize, window, wandersCount);
+        scalingFile << gridSize << "," << comparison.hybridDuration << "," << comparison.hybridError << ","
+                    << comparison.fullDuration << "," << comparison.fullError << std::endl;
+        std::cout << "Grid " << gridSize << ": hybrid " << comparison.hybridDuration << "s, window l1 error "
+                  << comparison.hybridError << ", full SOR " << comparison.fullDuration << "s, window l1 error "
+                  << comparison.fullError << ", speedup " << comparison.fullDuration / comparison.hybridDuration
+                  << std::endl;
+        if (crossover == 0 && comparison.hybridDuration < comparison.fullDuration) crossover = gridSize;
+    }
+    if (crossover > 0) {
+        std::cout << "The hybrid is faster from grid " << crossover << std::endl;
+    } else {
+        std::cout << "The full SOR is faster on all the grids" << std::endl;
+    }
+
+    const double step = 1.0 / (gridSize - 1);
+    std::ofstream file("data/hybrid.csv");
+    for (uint i = 0; i < window.sizeX(); i++) {
+        for (uint j = 0; j < window.sizeY(); j++) {
+            file << (window.fromI + i) * step << "," << (window.fromJ + j) * step << ","
+                 << comparison.hybridResult.function[{i, j}] << std::endl;
+        }
+    }
+}
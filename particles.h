@@ -12,15 +12,27 @@
 #include <random>
 #include <algorithm>
 #include <functional>
+#include <array>
+#include <numeric>
+#include <cstdint>
+#ifdef _OPENMP
+#include <omp.h>
+#endif
+#include "utils.h"
+#include "diagnostics.h"
+
+//All the random numbers of a thread are drawn from this engine, so its state can be saved to a checkpoint and restored
+std::mt19937_64 &getRandomEngine() {
+    static thread_local std::mt19937_64 engine{std::random_device()()};
+    return engine;
+}
 
 class Random {
 public:
     double get(){
-        return dist(engine);
+        return dist(getRandomEngine());
     }
 private:
-    std::random_device dev;
-    std::default_random_engine engine{dev()};
     std::uniform_real_distribution<double> dist{0, 1};
 };
 
@@ -114,9 +126,7 @@ public:
     double nextCollisionTime{0};
 };
 
-void saveTrajectories(const std::string &filename, const std::vector<Particle> &particles) {
-    std::ofstream file(filename);
-
+void saveTrajectories(std::ostream &file, const std::vector<Particle> &particles) {
     size_t size = particles[0].trajectory.size();
     for (const auto &particle : particles) {
         if (particle.trajectory.size() != size) {
@@ -139,6 +149,111 @@ void saveTrajectories(const std::string &filename, const std::vector<Particle> &
     }
 }
 
+void saveTrajectories(const std::string &filename, const std::vector<Particle> &particles) {
+    std::ofstream file(filename);
+    saveTrajectories(file, particles);
+}
+
+
+//One line of the same format as saveTrajectories, streamed right away instead of kept in Particle::trajectory
+void writeTrajectories(DiagnosticsWriter &writer, size_t stream, const std::vector<Particle> &particles, double time) {
+    PROFILE_PHASE("trajectories");
+    std::vector<double> line{time};
+    line.reserve(1 + 6 * particles.size());
+    for (const auto &particle : particles) {
+        line.insert(line.end(), {particle.position.x, particle.position.y, particle.position.z,
+                                 particle.velocity.x, particle.velocity.y, particle.velocity.z});
+    }
+    writer.write(stream, line.data(), line.size());
+}
+
+
+//Frees the trajectories of all the particles, e.g. when only the tracers are recorded
+void clearTrajectories(std::vector<Particle> &particles) {
+    for (auto &particle : particles) {
+        std::vector<PhasePoint>().swap(particle.trajectory);
+    }
+}
+
+//Trajectories of a subset of the particles (tracers) in one contiguous buffer preallocated for recordCount records,
+//point k of record i is points[i * tracerCount + k]. The other particles do not need any trajectory.
+class TracerRecorder {
+public:
+    TracerRecorder(std::vector<size_t> indices, size_t recordCount) : indices(std::move(indices)) {
+        points.reserve(recordCount * this->indices.size());
+    }
+
+    //tracerCount indices evenly spread over particleCount particles
+    static std::vector<size_t> selectEvenly(size_t particleCount, size_t tracerCount) {
+        std::vector<size_t> result;
+        auto stride = std::max<size_t>(1, particleCount / std::max<size_t>(1, tracerCount));
+        for (size_t i = 0; i < particleCount && result.size() < tracerCount; i += stride) {
+            result.emplace_back(i);
+        }
+        return result;
+    }
+
+    template<typename Predicate>
+    static std::vector<size_t> selectIf(const std::vector<Particle> &particles, Predicate predicate) {
+        std::vector<size_t> result;
+        for (size_t i = 0; i < particles.size(); i++) {
+            if (predicate(particles[i])) result.emplace_back(i);
+        }
+        return result;
+    }
+
+    void record(const std::vector<Particle> &particles, double time) {
+        PROFILE_PHASE("trajectories");
+        for (auto index : indices) {
+            const auto &particle = particles[index];
+            points.push_back({particle.position.x, particle.position.y, particle.position.z,
+                              particle.velocity.x, particle.velocity.y, particle.velocity.z, time});
+        }
+    }
+
+    //Same format as saveTrajectories, one line per record
+    void save(const std::string &filename) const {
+        std::ofstream file(filename);
+        for (size_t first = 0; first < points.size(); first += indices.size()) {
+            std::stringstream line;
+            line << points[first].t;
+            for (size_t k = first; k < first + indices.size(); k++) {
+                line << "," << points[k].x << "," << points[k].y << "," << points[k].z << ","
+                     << points[k].vx << "," << points[k].vy << "," << points[k].vz;
+            }
+            line << std::endl;
+            file << line.str();
+        }
+    }
+
+    //Follow the tracers after the particles were reordered, order[k] is the previous index of the particle now at k
+    void reorder(const std::vector<size_t> &order) {
+        std::vector<size_t> newIndex(order.size());
+        for (size_t k = 0; k < order.size(); k++) newIndex[order[k]] = k;
+        for (auto &index : indices) index = newIndex[index];
+    }
+
+    std::vector<PhasePoint> &getPoints() {
+        return points;
+    }
+
+    //Current indices of the tracers, they change with reorder
+    std::vector<size_t> &getIndices() {
+        return indices;
+    }
+
+private:
+    std::vector<size_t> indices;
+    std::vector<PhasePoint> points;
+};
+
+//Velocities of all the particles, one particle per line
+void saveVelocities(const std::string &filename, const std::vector<Particle> &particles) {
+    std::ofstream file(filename);
+    for (const auto &particle : particles) {
+        file << particle.velocity.x << "," << particle.velocity.y << "," << particle.velocity.z << std::endl;
+    }
+}
 
 void setAllForces(std::vector<Particle> &particles, const Vector &force) {
     for (auto &particle : particles) {
@@ -148,6 +263,7 @@ void setAllForces(std::vector<Particle> &particles, const Vector &force) {
 
 template<typename ForceCalculator>
 void updateForces(std::vector<Particle> &particles, const ForceCalculator &forceCalculator) {
+    PROFILE_PHASE("forces");
     for (uint i = 0; i < particles.size(); ++i) {
         for (uint j = i + 1; j < particles.size(); ++j) {
             auto force = forceCalculator(particles[i], particles[j]);
@@ -182,6 +298,7 @@ double getTotalKineticEnergy(const std::vector<Particle> &particles) {
 }
 
 void updateVelocities(std::vector<Particle> &particles, double timeStep) {
+    PROFILE_PHASE("velocities");
     for (auto &particle : particles) {
         particle.previousVelocity = particle.velocity;
         particle.velocity += timeStep * particle.getAcceleration();
@@ -190,39 +307,532 @@ void updateVelocities(std::vector<Particle> &particles, double timeStep) {
 
 
 void updatePositions(std::vector<Particle> &particles, double timeStep) {
+    PROFILE_PHASE("positions");
     for (auto &particle : particles) {
         particle.position += timeStep * particle.velocity;
     }
 }
 
 void updateTrajectories(std::vector<Particle> &particles, double currentTime) {
+    PROFILE_PHASE("trajectories");
     for (auto &particle : particles) {
         particle.updateTrajectory(currentTime);
     }
 }
 
+//Symplectic integrator of the given even order built by the triple jump composition (Yoshida) of the leapfrog.
+//The composition is flattened to alternating kicks (updateVelocities) and drifts (updatePositions), adjacent kicks
+//are merged and the forces of the last kick are reused by the first kick of the next step, so a step costs
+//one force evaluation per drift (1 for order 2, 3 for order 4, 9 for order 6).
+//Velocities are synchronous with the positions after each step (previousVelocity == velocity).
+template<int Order>
+class SymplecticIntegrator {
+    static_assert(Order >= 2 && Order % 2 == 0, "Only even orders are supported.");
+public:
+    SymplecticIntegrator() {
+        compose(Order, 1.0);
+    }
+
+    template<typename ForceCalculator>
+    void step(std::vector<Particle> &particles, double timeStep, const ForceCalculator &forceCalculator) {
+        for (uint i = 0; i < drifts.size(); i++) {
+            if (i > 0 || !forcesValid) {
+                setAllForces(particles, {0, 0});
+                updateForces(particles, forceCalculator);
+            }
+            updateVelocities(particles, kicks[i] * timeStep);
+            updatePositions(particles, drifts[i] * timeStep);
+        }
+        setAllForces(particles, {0, 0});
+        updateForces(particles, forceCalculator);
+        updateVelocities(particles, kicks.back() * timeStep);
+        forcesValid = true;
+        for (auto &particle : particles) {
+            particle.previousVelocity = particle.velocity;
+        }
+    }
+
+    //Call if the particles were changed outside of step
+    void invalidateForces() {
+        forcesValid = false;
+    }
+
+private:
+    std::vector<double> kicks;
+    std::vector<double> drifts;
+    bool forcesValid = false;
+
+    void compose(int order, double scale) {
+        if (order == 2) {
+            if (kicks.empty()) kicks.emplace_back(0);
+            kicks.back() += scale / 2;
+            drifts.emplace_back(scale);
+            kicks.emplace_back(scale / 2);
+            return;
+        }
+        auto root = std::pow(2.0, 1.0 / (order - 1));
+        auto outer = 1 / (2 - root);
+        auto inner = -root / (2 - root);
+        compose(order - 2, outer * scale);
+        compose(order - 2, inner * scale);
+        compose(order - 2, outer * scale);
+    }
+};
+
+//Fourth order Hermite predictor-corrector with block time steps. Every body has its own step
+//maxTimeStep / 2^k chosen by the Aarseth criterion, only the bodies whose step ends at the next block time
+//(the active ones) get new forces, all the others are just predicted. The bodies are synchronized
+//at multiples of maxTimeStep. ForceCalculator gives the force on a from b, JerkCalculator its time derivative.
+class HermiteIntegrator {
+public:
+    explicit HermiteIntegrator(double maxTimeStep, double accuracy = 0.01, int maxLevel = 30) :
+            maxTimeStep(maxTimeStep), accuracy(accuracy), maxLevel(maxLevel) {}
+
+    //time has to be a multiple of maxTimeStep
+    template<typename ForceCalculator, typename JerkCalculator>
+    void advanceTo(
+            std::vector<Particle> &particles,
+            double time,
+            const ForceCalculator &forceCalculator,
+            const JerkCalculator &jerkCalculator
+    ) {
+        if (predicted.size() != particles.size()) initialize(particles, forceCalculator, jerkCalculator);
+        const auto endTick = (long long) std::llround(time / tick());
+        std::vector<size_t> active;
+        while (true) {
+            long long nextTick = endTick;
+            for (size_t i = 0; i < particles.size(); i++) {
+                nextTick = std::min(nextTick, times[i] + steps[i]);
+            }
+            if (nextTick <= currentTick) break;
+            active.clear();
+            for (size_t i = 0; i < particles.size(); i++) {
+                if (times[i] + steps[i] == nextTick) active.emplace_back(i);
+            }
+
+            //main routine
+            //Predict everybody, evaluate the forces for the active bodies only and correct them. correct
+            //overwrites the predicted state, so all the active bodies are evaluated first.
+            predict(particles, nextTick);
+            activeAccelerations.resize(active.size());
+            activeJerks.resize(active.size());
+            for (size_t k = 0; k < active.size(); k++) {
+                evaluate(active[k], forceCalculator, jerkCalculator, activeAccelerations[k], activeJerks[k]);
+            }
+            for (size_t k = 0; k < active.size(); k++) {
+                correct(particles[active[k]], active[k], activeAccelerations[k], activeJerks[k], nextTick);
+            }
+            currentTick = nextTick;
+        }
+        for (auto &particle : particles) {
+            particle.previousVelocity = particle.velocity;
+        }
+    }
+
+    long getForceEvaluations() const {
+        return forceEvaluations;
+    }
+
+private:
+    double maxTimeStep, accuracy;
+    int maxLevel;
+    long long currentTick = 0;
+    long forceEvaluations = 0;
+    std::vector<Particle> predicted; //workspace with the predicted positions and velocities, no trajectories
+    std::vector<Vector> accelerations, jerks;
+    std::vector<Vector> activeAccelerations, activeJerks; //new values of the active bodies until they are corrected
+    std::vector<long long> times, steps; //in ticks, the smallest possible step
+
+    double tick() const {
+        return maxTimeStep / (1LL << maxLevel);
+    }
+
+    template<typename ForceCalculator, typename JerkCalculator>
+    void initialize(std::vector<Particle> &particles, const ForceCalculator &forceCalculator, const JerkCalculator &jerkCalculator) {
+        predicted.clear();
+        for (const auto &particle : particles) {
+            predicted.emplace_back(Particle(particle.mass, particle.position, particle.velocity, particle.charge));
+            predicted.back().trajectory.clear();
+        }
+        accelerations.assign(particles.size(), {0, 0, 0});
+        jerks.assign(particles.size(), {0, 0, 0});
+        times.assign(particles.size(), currentTick);
+        steps.assign(particles.size(), 0);
+        for (size_t i = 0; i < particles.size(); i++) {
+            evaluate(i, forceCalculator, jerkCalculator, accelerations[i], jerks[i]);
+            auto step = accuracy * accelerations[i].getNorm() / std::max(jerks[i].getNorm(), 1e-300);
+            steps[i] = quantize(step, currentTick, 1LL << maxLevel);
+        }
+    }
+
+    //Largest power of two step (in ticks) not exceeding step and limit, and commensurate with the time
+    long long quantize(double step, long long time, long long limit) const {
+        long long result = 1LL << maxLevel;
+        while (result > 1 && (result * tick() > step || result > limit || time % result != 0)) result /= 2;
+        return result;
+    }
+
+    void predict(const std::vector<Particle> &particles, long long tick) {
+        for (size_t i = 0; i < particles.size(); i++) {
+            auto dt = (tick - times[i]) * this->tick();
+            predicted[i].position = particles[i].position + dt * particles[i].velocity +
+                                    (dt * dt / 2) * accelerations[i] + (dt * dt * dt / 6) * jerks[i];
+            predicted[i].velocity = particles[i].velocity + dt * accelerations[i] + (dt * dt / 2) * jerks[i];
+        }
+    }
+
+    template<typename ForceCalculator, typename JerkCalculator>
+    void evaluate(
+            size_t i,
+            const ForceCalculator &forceCalculator,
+            const JerkCalculator &jerkCalculator,
+            Vector &acceleration,
+            Vector &jerk
+    ) {
+        Vector force{0, 0, 0}, forceDerivative{0, 0, 0};
+        for (size_t j = 0; j < predicted.size(); j++) {
+            if (j == i) continue;
+            force += forceCalculator(predicted[i], predicted[j]);
+            forceDerivative += jerkCalculator(predicted[i], predicted[j]);
+            forceEvaluations++;
+        }
+        acceleration = 1.0 / predicted[i].mass * force;
+        jerk = 1.0 / predicted[i].mass * forceDerivative;
+    }
+
+    void correct(Particle &particle, size_t i, const Vector &acceleration, const Vector &jerk, long long tick) {
+        auto dt = (tick - times[i]) * this->tick();
+        auto a0 = accelerations[i], j0 = jerks[i];
+        auto velocity = particle.velocity + (dt / 2) * (a0 + acceleration) + (dt * dt / 12) * (j0 - jerk);
+        particle.position = particle.position + (dt / 2) * (particle.velocity + velocity) +
+                            (dt * dt / 12) * (a0 - acceleration);
+        particle.velocity = velocity;
+        predicted[i].position = particle.position;
+        predicted[i].velocity = particle.velocity;
+
+        //Aarseth criterion from the second and third derivatives of the Hermite interpolation
+        auto snap = 1 / (dt * dt) * (-6.0 * (a0 - acceleration) - dt * (4.0 * j0 + 2.0 * jerk));
+        auto crackle = 1 / (dt * dt * dt) * (12.0 * (a0 - acceleration) + 6.0 * dt * (j0 + jerk));
+        snap += dt * crackle;
+        auto a = acceleration.getNorm(), j = jerk.getNorm(), s = snap.getNorm(), c = crackle.getNorm();
+        auto step = std::sqrt(accuracy * (a * s + j * j) / std::max(j * c + s * s, 1e-300));
+
+        accelerations[i] = acceleration;
+        jerks[i] = jerk;
+        times[i] = tick;
+        steps[i] = quantize(step, tick, 2 * steps[i]);
+    }
+};
+
 struct Interval {
     double begin;
     double end;
 };
 
 void applyPeriodicBorderCondition(std::vector<Particle> &particles, Interval sideX, Interval sideY) {
+    PROFILE_PHASE("boundary");
+    long crossings = 0;
     for (auto &particle : particles) {
         if (particle.position.x > sideX.end) {
             particle.position.x = sideX.begin;
+            crossings++;
         }
         if (particle.position.x < sideX.begin) {
             particle.position.x = sideX.end;
+            crossings++;
         }
         if (particle.position.y > sideY.end) {
             particle.position.y = sideY.begin;
+            crossings++;
         }
         if (particle.position.y < sideY.begin) {
             particle.position.y = sideY.end;
+            crossings++;
+        }
+    }
+    PROFILE_COUNT("boundary crossings", crossings);
+}
+
+//Coulomb force on a from b screened at the Debye length, negligible beyond a few Debye lengths
+struct ScreenedCoulombLaw {
+    double debyeLength;
+
+    Vector operator()(const Particle &a, const Particle &b) const {
+        const double k = 8.9875517923e9; //1 / (4 pi epsilon0)
+        auto r = b.position - a.position;
+        auto abs_r = r.getNorm();
+        auto magnitude = k * a.charge * b.charge * std::exp(-abs_r / debyeLength) *
+                         (1 / (abs_r * abs_r) + 1 / (abs_r * debyeLength));
+        return -magnitude / abs_r * r;
+    }
+};
+
+//Linked cells for short range interactions in the periodic box of applyPeriodicBorderCondition.
+//The box is split into cells at least cutoff wide, so the partners of a particle closer than cutoff are in its own
+//cell or one of the 8 neighbouring cells (with the periodic images across the box sides). Cost is O(N) per step
+//for a bounded number of particles per cell. The cells are in the x-y plane, z is not periodic.
+class CellList {
+public:
+    CellList(Interval sideX, Interval sideY, double cutoff) :
+            sideX(sideX),
+            sideY(sideY),
+            cutoff(cutoff),
+            countX((size_t) ((sideX.end - sideX.begin) / cutoff)),
+            countY((size_t) ((sideY.end - sideY.begin) / cutoff)) {
+        //With less than 3 cells a neighbouring cell would be visited twice
+        if (countX < 3 || countY < 3) {
+            throw std::invalid_argument("The box has to be at least 3 cutoffs wide.");
+        }
+        cells.resize(countX * countY);
+    }
+
+    //Only the particles which left their cell since the last update are moved, all of them if the count changed
+    void update(const std::vector<Particle> &particles) {
+        if (particles.size() != cellOf.size()) {
+            for (auto &cell : cells) cell.clear();
+            cellOf.assign(particles.size(), 0);
+            slotOf.assign(particles.size(), 0);
+            for (size_t i = 0; i < particles.size(); i++) insert(i, getCell(particles[i].position));
+            return;
+        }
+        for (size_t i = 0; i < particles.size(); i++) {
+            auto cell = getCell(particles[i].position);
+            if (cell != cellOf[i]) {
+                remove(i);
+                insert(i, cell);
+            }
+        }
+    }
+
+    //The next update rebuilds all the cells, e.g. after the particles were reordered
+    void invalidate() {
+        cellOf.clear();
+    }
+
+    //Same as updateForces but only for the pairs closer than cutoff, the nearest periodic image of the partner is used.
+    //Every particle sums the forces from its own partners, so the threads never write to the same particle.
+    template<typename ForceCalculator>
+    void updateForces(std::vector<Particle> &particles, const ForceCalculator &forceCalculator) {
+        PROFILE_PHASE("cell list forces");
+        update(particles);
+        const auto lengthX = sideX.end - sideX.begin, lengthY = sideY.end - sideY.begin;
+        const auto cutoff2 = cutoff * cutoff;
+        const auto size = (long) particles.size();
+        //Compact copy of the positions, the distance checks then do not touch the whole Particle
+        positions.resize(particles.size());
+        for (size_t i = 0; i < particles.size(); i++) positions[i] = particles[i].position;
+
+        #pragma omp parallel
+        {
+            //Partner moved to its periodic image, only the plain fields are copied
+            Particle image(0, {0, 0, 0}, {0, 0, 0});
+            #pragma omp for schedule(static)
+            for (long i = 0; i < size; i++) {
+                auto &particle = particles[i];
+                auto cellX = cellOf[i] % countX, cellY = cellOf[i] / countX;
+                for (size_t dy = 0; dy < 3; dy++) {
+                    for (size_t dx = 0; dx < 3; dx++) {
+                        auto neighbourX = (cellX + countX + dx - 1) % countX;
+                        auto neighbourY = (cellY + countY + dy - 1) % countY;
+                        for (auto j : cells[neighbourX + neighbourY * countX]) {
+                            if (j == (size_t) i) continue;
+                            auto r = positions[j] - positions[i];
+                            auto shiftX = lengthX * std::round(r.x / lengthX);
+                            auto shiftY = lengthY * std::round(r.y / lengthY);
+                            r.x -= shiftX;
+                            r.y -= shiftY;
+                            if (r.x * r.x + r.y * r.y + r.z * r.z >= cutoff2) continue;
+                            const auto &partner = particles[j];
+
+                            //main routine
+                            if (shiftX == 0 && shiftY == 0) {
+                                particle.force += forceCalculator(particle, partner);
+                            } else {
+                                image.position = particle.position + r;
+                                image.velocity = partner.velocity;
+                                image.previousVelocity = partner.previousVelocity;
+                                image.relativisticVelocity = partner.relativisticVelocity;
+                                image.mass = partner.mass;
+                                image.charge = partner.charge;
+                                particle.force += forceCalculator(particle, image);
+                            }
+                        }
+                    }
+                }
+            }
+        }
+    }
+
+private:
+    Interval sideX, sideY;
+    double cutoff;
+    size_t countX, countY;
+    std::vector<std::vector<size_t>> cells;
+    std::vector<size_t> cellOf; //cell of each particle
+    std::vector<size_t> slotOf; //index of each particle in its cell
+    std::vector<Vector> positions;
+
+    //Positions outside of the box (not yet wrapped by applyPeriodicBorderCondition) fall into the periodic cell
+    size_t getCell(const Vector &position) const {
+        auto getIndex = [](double coordinate, const Interval &side, size_t count) {
+            auto index = (long) std::floor((coordinate - side.begin) / (side.end - side.begin) * count) % (long) count;
+            return (size_t) (index < 0 ? index + (long) count : index);
+        };
+        return getIndex(position.x, sideX, countX) + getIndex(position.y, sideY, countY) * countX;
+    }
+
+    void insert(size_t particle, size_t cell) {
+        cellOf[particle] = cell;
+        slotOf[particle] = cells[cell].size();
+        cells[cell].emplace_back(particle);
+    }
+
+    //The last particle of the cell takes the free slot
+    void remove(size_t particle) {
+        auto &cell = cells[cellOf[particle]];
+        auto last = cell.back();
+        cell[slotOf[particle]] = last;
+        slotOf[last] = slotOf[particle];
+        cell.pop_back();
+    }
+};
+
+//Interleaved bits of the cell coordinates (x in the even bits), cells close in the plane get close keys
+uint32_t getMortonKey(uint32_t cellX, uint32_t cellY) {
+    auto spread = [](uint32_t v) {
+        v &= 0xffff;
+        v = (v | (v << 8)) & 0x00ff00ff;
+        v = (v | (v << 4)) & 0x0f0f0f0f;
+        v = (v | (v << 2)) & 0x33333333;
+        v = (v | (v << 1)) & 0x55555555;
+        return v;
+    };
+    return spread(cellX) | (spread(cellY) << 1);
+}
+
+//Morton keys of count positions on a 2^bits x 2^bits grid over the box, getPosition(k) returns the k-th position.
+//Positions outside of the box fall into the border cells.
+template<typename Position>
+std::vector<uint32_t> getMortonKeys(size_t count, Position getPosition, Interval sideX, Interval sideY, uint32_t bits) {
+    const auto cells = (double) (1u << bits);
+    auto getCell = [cells](double coordinate, const Interval &side) {
+        auto cell = std::floor((coordinate - side.begin) / (side.end - side.begin) * cells);
+        return (uint32_t) std::min(std::max(cell, 0.0), cells - 1);
+    };
+    std::vector<uint32_t> keys(count);
+    #pragma omp parallel for schedule(static)
+    for (long k = 0; k < (long) count; k++) {
+        Vector position = getPosition(k);
+        keys[k] = getMortonKey(getCell(position.x, sideX), getCell(position.y, sideY));
+    }
+    return keys;
+}
+
+//Stable least significant digit radix sort of keys smaller than 2^keyBits by 8 bit digits. Returns the order,
+//order[k] is the index of the k-th smallest key. Every thread counts the digits of its own contiguous chunk and
+//scatters it to the offsets summed in the thread order, so the order is the same for any number of threads.
+std::vector<size_t> radixSortOrder(const std::vector<uint32_t> &keys, uint32_t keyBits = 32) {
+    PROFILE_PHASE("radix sort");
+    const auto size = keys.size();
+    //The keys travel with the indices, so the passes read them sequentially
+    std::vector<size_t> order(size), buffer(size);
+    std::vector<uint32_t> sortedKeys(keys), keyBuffer(size);
+    std::iota(order.begin(), order.end(), 0);
+#ifdef _OPENMP
+    const int maxThreads = omp_get_max_threads();
+#else
+    const int maxThreads = 1;
+#endif
+    std::vector<std::array<size_t, 256>> counts(maxThreads);
+
+    for (uint32_t shift = 0; shift < keyBits; shift += 8) {
+        #pragma omp parallel
+        {
+#ifdef _OPENMP
+            const int thread = omp_get_thread_num(), threadCount = omp_get_num_threads();
+#else
+            const int thread = 0, threadCount = 1;
+#endif
+            const auto begin = size * thread / threadCount, end = size * (thread + 1) / threadCount;
+            auto &count = counts[thread];
+            count.fill(0);
+            for (size_t k = begin; k < end; k++) count[(sortedKeys[k] >> shift) & 255]++;
+
+            #pragma omp barrier
+            #pragma omp single
+            {
+                size_t offset = 0;
+                for (size_t digit = 0; digit < 256; digit++) {
+                    for (int t = 0; t < threadCount; t++) {
+                        auto digitCount = counts[t][digit];
+                        counts[t][digit] = offset;
+                        offset += digitCount;
+                    }
+                }
+            }
+
+            for (size_t k = begin; k < end; k++) {
+                auto position = count[(sortedKeys[k] >> shift) & 255]++;
+                buffer[position] = order[k];
+                keyBuffer[position] = sortedKeys[k];
+            }
         }
+        std::swap(order, buffer);
+        std::swap(sortedKeys, keyBuffer);
     }
+    return order;
+}
+
+//values[k] = previous values[order[k]]
+template<typename T>
+void reorder(std::vector<T> &values, const std::vector<size_t> &order) {
+    std::vector<T> result;
+    result.reserve(values.size());
+    for (auto index : order) result.emplace_back(std::move(values[index]));
+    values = std::move(result);
 }
 
+//Every interval steps the particles are reordered by the Morton key of their cell on a 2^bits x 2^bits grid,
+//so particles close in the box are close in memory. Anything indexed by the particles has to follow the new order,
+//see TracerRecorder::reorder and CellList::invalidate.
+class SpatialSorter {
+public:
+    SpatialSorter(Interval sideX, Interval sideY, int interval, uint32_t bits = 10) :
+            sideX(sideX),
+            sideY(sideY),
+            interval(interval),
+            bits(bits) {}
+
+    //Returns true if the particles were reordered, getOrder is then the applied order
+    bool sort(std::vector<Particle> &particles, long step) {
+        if (interval <= 0 || step % interval != 0) return false;
+        if (ids.size() != particles.size()) {
+            ids.resize(particles.size());
+            std::iota(ids.begin(), ids.end(), 0);
+        }
+        auto keys = getMortonKeys(particles.size(), [&](size_t k) { return particles[k].position; }, sideX, sideY, bits);
+        order = radixSortOrder(keys, 2 * bits);
+        ::reorder(particles, order);
+        ::reorder(ids, order);
+        return true;
+    }
+
+    const std::vector<size_t> &getOrder() const {
+        return order;
+    }
+
+    //Index of the particle of each slot in the original order
+    const std::vector<size_t> &getIds() const {
+        return ids;
+    }
+
+private:
+    Interval sideX, sideY;
+    int interval;
+    uint32_t bits;
+    std::vector<size_t> order, ids;
+};
+
 std::vector<Particle> generateInRectangle(size_t count, Interval sideX, Interval sideY, double mass) {
     std::random_device dev;
     std::default_random_engine generator(dev());
@@ -246,12 +856,11 @@ public:
         auto m = mass;
         double stddev = std::sqrt(k * T / m);
         std::normal_distribution<double> distribution(mean, stddev);
+        auto &generator = getRandomEngine();
         return {distribution(generator), distribution(generator), distribution(generator)};
     }
 private:
     const double k = 1.38064852e-23;
-    std::random_device dev;
-    std::default_random_engine generator{dev()};
 };
 
 void collide(Particle &particle, double backgroundParticleMass, double backgroundParticlesTemperature) {
@@ -300,20 +909,27 @@ void collide(
         Frequency getFrequency,
         double backgroundTemperature = 0
 ) {
+    PROFILE_PHASE("collisions");
+    long collisions = 0, nullCollisions = 0;
     Random R01;
     for (auto &particle : particles) {
         if (currentTime > particle.nextCollisionTime) {
             auto probability = getFrequency(particle.velocity.getNorm()) / maxFrequency;
-            if (R01.get() > probability) {
+            if (R01.get() < probability) {
                 if (backgroundTemperature == 0){
                     collide(particle, backgroundParticleMass);
                 } else {
                     collide(particle, backgroundParticleMass, backgroundTemperature);
                 }
+                collisions++;
+            } else {
+                nullCollisions++;
             }
             setNextCollisionTime(particle, maxFrequency);
         }
     }
+    PROFILE_COUNT("collisions", collisions);
+    PROFILE_COUNT("null collisions", nullCollisions);
 }
 
 void initCollisionTimes(std::vector<Particle>& particles, double maxFrequency){
@@ -322,6 +938,227 @@ void initCollisionTimes(std::vector<Particle>& particles, double maxFrequency){
     }
 }
 
+//One collision process with the background, e.g. elastic scattering or an excitation losing energyLoss [J]
+struct CollisionChannel {
+    std::string name;
+    double energyLoss;
+    std::vector<double> frequencies; //at the speeds of the table
+};
+
+//Collision frequencies of several channels tabulated at the evenly spaced speeds 0, speedStep, 2 * speedStep, ...
+//and linearly interpolated in between, the last value holds for higher speeds. The speed range is split into bands,
+//the majorant of a band is the maximal total frequency in it, so a particle keeping its speed between collisions
+//(no fields) draws its collision times with the bound of its own band instead of the global maximum.
+//The bands are only valid if the speed changes at collisions alone. When forces act between the collisions the
+//band of the draw is not the band of the test anymore, build the table with bandCount = 1, then every majorant is
+//the global maximum, see getMaxFrequency.
+class CollisionTable {
+public:
+    CollisionTable(std::vector<CollisionChannel> channels, double speedStep, size_t bandCount = 16) :
+            channels(std::move(channels)),
+            speedStep(speedStep) {
+        if (this->channels.empty() || this->channels.front().frequencies.size() < 2 || speedStep <= 0) {
+            throw std::invalid_argument("Collision table needs at least one channel with two speeds.");
+        }
+        auto pointCount = this->channels.front().frequencies.size();
+        totals.assign(pointCount, 0);
+        for (const auto &channel : this->channels) {
+            if (channel.frequencies.size() != pointCount) {
+                throw std::invalid_argument("Channel " + channel.name + " has a different number of speeds.");
+            }
+            for (size_t i = 0; i < pointCount; i++) totals[i] += channel.frequencies[i];
+        }
+
+        //The interpolation is linear so the maximum over the nodes of a band, both ends included, bounds it exactly
+        bandWidth = std::max<size_t>(1, (pointCount - 1 + bandCount - 1) / std::max<size_t>(1, bandCount));
+        for (size_t first = 0; first + 1 < pointCount; first += bandWidth) {
+            auto last = std::min(first + bandWidth, pointCount - 1);
+            majorants.emplace_back(*std::max_element(totals.begin() + first, totals.begin() + last + 1));
+        }
+    }
+
+    //Single elastic channel of the given frequency at all speeds
+    static CollisionTable constant(double frequency) {
+        return CollisionTable({{"elastic", 0, {frequency, frequency}}}, 1, 1);
+    }
+
+    //Cross sections [m^2] against energy [eV] from a csv file, e.g.
+    //  energy,elastic,excitation:11.55
+    //  0,7.5e-20,0
+    //  ...
+    //The header names the channels, an inelastic channel states its energy loss [eV] after a colon. Lines starting
+    //with # are skipped. The frequencies n sigma(E) v of a particle of the given mass in a background of the given
+    //density [m^-3] are tabulated at pointCount speeds up to the highest energy of the file.
+    static CollisionTable load(
+            const std::string &filename,
+            double particleMass,
+            double backgroundDensity,
+            size_t pointCount = 4096,
+            size_t bandCount = 16
+    ) {
+        const double electronVolt = 1.602176634e-19;
+        std::ifstream file(filename);
+        if (!file) throw std::runtime_error("Cannot open collision table " + filename);
+
+        auto split = [](const std::string &line) {
+            std::vector<std::string> cells;
+            std::stringstream stream(line);
+            std::string cell;
+            while (std::getline(stream, cell, ',')) cells.emplace_back(cell);
+            return cells;
+        };
+
+        std::vector<CollisionChannel> channels;
+        std::vector<double> energies;
+        std::vector<std::vector<double>> crossSections;
+        std::string line;
+        while (std::getline(file, line)) {
+            if (line.empty() || line[0] == '#') continue;
+            auto cells = split(line);
+            if (channels.empty()) {
+                if (cells.size() < 2) throw std::runtime_error("Collision table has no channels: " + filename);
+                for (size_t i = 1; i < cells.size(); i++) {
+                    auto colon = cells[i].find(':');
+                    auto loss = colon == std::string::npos ? 0 : std::stod(cells[i].substr(colon + 1));
+                    channels.push_back({cells[i].substr(0, colon), loss * electronVolt, {}});
+                    crossSections.emplace_back();
+                }
+                continue;
+            }
+            if (cells.size() != channels.size() + 1) throw std::runtime_error("Invalid collision table line: " + line);
+            auto energy = std::stod(cells[0]);
+            if (!energies.empty() && energy <= energies.back()) {
+                throw std::runtime_error("Collision table energies must increase: " + line);
+            }
+            energies.emplace_back(energy * electronVolt);
+            for (size_t i = 0; i < channels.size(); i++) crossSections[i].emplace_back(std::stod(cells[i + 1]));
+        }
+        if (energies.size() < 2 || pointCount < 2) throw std::runtime_error("Collision table is too short: " + filename);
+
+        auto maxSpeed = std::sqrt(2 * energies.back() / particleMass);
+        auto speedStep = maxSpeed / (pointCount - 1);
+        for (size_t i = 0; i < pointCount; i++) {
+            auto speed = i * speedStep;
+            auto energy = std::min(0.5 * particleMass * speed * speed, energies.back());
+            //Index of the file interval containing the energy, the first value holds below the first energy
+            auto upper = std::upper_bound(energies.begin(), energies.end(), energy) - energies.begin();
+            auto right = std::min<size_t>(std::max<size_t>(upper, 1), energies.size() - 1);
+            auto left = right - 1;
+            auto weight = std::max(0.0, (energy - energies[left]) / (energies[right] - energies[left]));
+            for (size_t k = 0; k < channels.size(); k++) {
+                auto sigma = crossSections[k][left] + weight * (crossSections[k][right] - crossSections[k][left]);
+                auto open = energy >= channels[k].energyLoss;
+                channels[k].frequencies.emplace_back(open ? backgroundDensity * sigma * speed : 0);
+            }
+        }
+        return CollisionTable(std::move(channels), speedStep, bandCount);
+    }
+
+    double getFrequency(double speed) const {
+        return interpolate(totals, speed);
+    }
+
+    double getFrequency(double speed, size_t channel) const {
+        return interpolate(channels[channel].frequencies, speed);
+    }
+
+    //Upper bound of the total frequency in the band of the speed
+    double getMajorant(double speed) const {
+        return majorants[std::min(getIndex(speed) / bandWidth, majorants.size() - 1)];
+    }
+
+    double getMaxFrequency() const {
+        return *std::max_element(majorants.begin(), majorants.end());
+    }
+
+    //Channel k is chosen with probability frequency_k / frequency for a uniform random number in [0, 1)
+    size_t selectChannel(double speed, double random) const {
+        auto target = random * getFrequency(speed);
+        for (size_t k = 0; k + 1 < channels.size(); k++) {
+            target -= getFrequency(speed, k);
+            if (target < 0) return k;
+        }
+        return channels.size() - 1;
+    }
+
+    const CollisionChannel &getChannel(size_t channel) const {
+        return channels[channel];
+    }
+
+    size_t getChannelCount() const {
+        return channels.size();
+    }
+
+private:
+    std::vector<CollisionChannel> channels;
+    std::vector<double> totals, majorants;
+    double speedStep;
+    size_t bandWidth;
+
+    size_t getIndex(double speed) const {
+        return (size_t) std::min(speed / speedStep, (double) (totals.size() - 1));
+    }
+
+    double interpolate(const std::vector<double> &values, double speed) const {
+        auto index = getIndex(speed);
+        if (index + 1 >= values.size()) return values.back();
+        auto weight = speed / speedStep - index;
+        return values[index] + weight * (values[index + 1] - values[index]);
+    }
+};
+
+//The next event is drawn with the majorant of the band of the current speed, see CollisionTable for the
+//restriction to runs without forces
+void setNextCollisionTime(Particle &particle, const CollisionTable &table) {
+    Random R01;
+    particle.nextCollisionTime += -1 / table.getMajorant(particle.velocity.getNorm()) * std::log(1 - R01.get());
+}
+
+//Null collision method with the banded majorants of the table. A real collision picks one of the channels, an
+//inelastic channel takes its energy loss from the particle before it is scattered.
+void collide(
+        std::vector<Particle> &particles,
+        double backgroundParticleMass,
+        double currentTime,
+        const CollisionTable &table,
+        double backgroundTemperature = 0
+) {
+    PROFILE_PHASE("collisions");
+    long collisions = 0, nullCollisions = 0;
+    Random R01;
+    for (auto &particle : particles) {
+        if (currentTime > particle.nextCollisionTime) {
+            //Without forces the speed did not change since the event was drawn, so this is the majorant it was
+            //drawn with. With forces the table has a single band and the majorant does not depend on the speed.
+            auto speed = particle.velocity.getNorm();
+            if (R01.get() * table.getMajorant(speed) < table.getFrequency(speed)) {
+                const auto &channel = table.getChannel(table.selectChannel(speed, R01.get()));
+                if (channel.energyLoss > 0) {
+                    auto energy = 0.5 * particle.mass * speed * speed;
+                    particle.velocity = std::sqrt(std::max(0.0, 1 - channel.energyLoss / energy)) * particle.velocity;
+                }
+                if (backgroundTemperature == 0){
+                    collide(particle, backgroundParticleMass);
+                } else {
+                    collide(particle, backgroundParticleMass, backgroundTemperature);
+                }
+                collisions++;
+            } else {
+                nullCollisions++;
+            }
+            setNextCollisionTime(particle, table);
+        }
+    }
+    PROFILE_COUNT("collisions", collisions);
+    PROFILE_COUNT("null collisions", nullCollisions);
+}
+
+void initCollisionTimes(std::vector<Particle>& particles, const CollisionTable &table){
+    for (auto& particle : particles){
+        setNextCollisionTime(particle, table);
+    }
+}
+
 //Simply set each coordinate of velocity to be from normal distribution
 void setThermalVelocities(std::vector<Particle> &particles, double temperature) {
     VectorMaxwellDistribution distribution;
@@ -330,14 +1167,28 @@ void setThermalVelocities(std::vector<Particle> &particles, double temperature)
     });
 }
 
+//Collects the velocities of the particles leaving the box, in memory or streamed to the writer if one is given
 class SideSampler {
 public:
+    SideSampler() = default;
+
+    SideSampler(DiagnosticsWriter &writer, size_t stream) : writer(&writer), stream(stream) {}
+
     void sample(std::vector<Particle> &particles, const Interval &sideX) {
+        PROFILE_PHASE("side sampling");
         for (const auto &particle : particles) {
             if (particle.position.x > sideX.end || particle.position.x < sideX.begin) {
                 this->speeds.emplace_back(particle.velocity);
             }
         }
+        if (writer && !speeds.empty()) {
+            writer->write(stream, &speeds.front().x, 3 * speeds.size(), 3);
+            speeds.clear();
+        }
+    }
+
+    std::vector<Vector> &getSpeeds() {
+        return speeds;
     }
 
     void save(const std::string &filename) const {
@@ -349,6 +1200,8 @@ public:
 
 private:
     std::vector<Vector> speeds;
+    DiagnosticsWriter *writer = nullptr;
+    size_t stream = 0;
 };
 
 #endif //PMPL_PARTICLES_H
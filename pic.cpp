@@ -0,0 +1,282 @@
+#include <iostream>
+#include <fstream>
+#include <vector>
+#include <cmath>
+#include <limits>
+#include <chrono>
+#include <string>
+#ifdef _OPENMP
+#include <omp.h>
+#endif
+#include "particles.h"
+#include "boris.h"
+#include "units.h"
+#include "sor.h"
+#include "checkpoint.h"
+
+const double epsilon0 = 8.8541878128e-12;
+
+//Square grid of size x size nodes with the node spacing step, node (i, j) is at (i * step, j * step)
+struct Mesh {
+    uint size;
+    double step;
+
+    double length() const {
+        return (size - 1) * step;
+    }
+};
+
+//Cloud in cell weights of the particle at (x, y), the particle lies in the cell with lower left node (i, j)
+struct CellWeights {
+    uint i, j;
+    double w00, w10, w01, w11;
+};
+
+CellWeights getCellWeights(double x, double y, const Mesh &mesh) {
+    auto cellX = std::min(std::max(x / mesh.step, 0.0), mesh.size - 1.0 - 1e-9);
+    auto cellY = std::min(std::max(y / mesh.step, 0.0), mesh.size - 1.0 - 1e-9);
+    auto i = (uint) cellX, j = (uint) cellY;
+    auto fx = cellX - i, fy = cellY - j;
+    return {i, j, (1 - fx) * (1 - fy), fx * (1 - fy), (1 - fx) * fy, fx * fy};
+}
+
+//Charge density of the block particles, cellCharge is the charge of one macro particle over the cell area.
+//mesh is in the units of the block positions.
+//Every thread deposits into its own grid, the grids are summed afterwards in the thread order,
+//so for a given thread count the result is the same in every run (and after a restart).
+template<typename T>
+void depositCharge(const BasicParticleBlock<T> &block, double cellCharge, const Mesh &mesh, Vector2D<double> &rho) {
+    const auto size = (long) block.size();
+#ifdef _OPENMP
+    const int threadCount = omp_get_max_threads();
+#else
+    const int threadCount = 1;
+#endif
+    std::vector<Vector2D<double>> localRhos(threadCount, Vector2D<double>(mesh.size));
+
+    #pragma omp parallel
+    {
+#ifdef _OPENMP
+        auto &localRho = localRhos[omp_get_thread_num()];
+#else
+        auto &localRho = localRhos[0];
+#endif
+        #pragma omp for schedule(static)
+        for (long n = 0; n < size; n++) {
+            auto w = getCellWeights(block.x[n], block.y[n], mesh);
+            localRho[{w.i, w.j}] += cellCharge * w.w00;
+            localRho[{w.i + 1, w.j}] += cellCharge * w.w10;
+            localRho[{w.i, w.j + 1}] += cellCharge * w.w01;
+            localRho[{w.i + 1, w.j + 1}] += cellCharge * w.w11;
+        }
+    }
+    for (auto &localRho : localRhos) {
+        for (uint i = 0; i < mesh.size; i++) {
+            for (uint j = 0; j < mesh.size; j++) {
+                rho[{i, j}] += localRho[{i, j}];
+            }
+        }
+    }
+}
+
+//E = -grad(phi), central differences inside and one sided differences on the border
+void computeField(const Vector2D<double> &phi, const Mesh &mesh, Vector2D<double> &Ex, Vector2D<double> &Ey) {
+    const auto N = mesh.size;
+    const auto h = mesh.step;
+    for (uint j = 0; j < N; j++) {
+        for (uint i = 0; i < N; i++) {
+            auto left = i > 0 ? i - 1 : i, right = i < N - 1 ? i + 1 : i;
+            auto down = j > 0 ? j - 1 : j, up = j < N - 1 ? j + 1 : j;
+            Ex[{i, j}] = -(phi[{right, j}] - phi[{left, j}]) / ((right - left) * h);
+            Ey[{i, j}] = -(phi[{i, up}] - phi[{i, down}]) / ((up - down) * h);
+        }
+    }
+}
+
+//Interpolate the grid field to the particles with the same weights as the deposition, the particle field is
+//in the units of fieldUnit
+template<typename T>
+void gatherField(
+        const BasicParticleBlock<T> &block,
+        const Mesh &mesh,
+        const Vector2D<double> &Ex,
+        const Vector2D<double> &Ey,
+        double fieldUnit,
+        std::vector<T> &particleEx,
+        std::vector<T> &particleEy
+) {
+    const auto size = (long) block.size();
+    #pragma omp parallel for
+    for (long n = 0; n < size; n++) {
+        auto w = getCellWeights(block.x[n], block.y[n], mesh);
+        particleEx[n] = (w.w00 * Ex[{w.i, w.j}] + w.w10 * Ex[{w.i + 1, w.j}] +
+                         w.w01 * Ex[{w.i, w.j + 1}] + w.w11 * Ex[{w.i + 1, w.j + 1}]) / fieldUnit;
+        particleEy[n] = (w.w00 * Ey[{w.i, w.j}] + w.w10 * Ey[{w.i + 1, w.j}] +
+                         w.w01 * Ey[{w.i, w.j + 1}] + w.w11 * Ey[{w.i + 1, w.j + 1}]) / fieldUnit;
+    }
+}
+
+//Grounded conducting box, particles are specularly reflected from the walls
+template<typename T>
+void applyReflectingBorderCondition(BasicParticleBlock<T> &block, T length) {
+    for (size_t n = 0; n < block.size(); n++) {
+        if (block.x[n] < 0) { block.x[n] = -block.x[n]; block.vx[n] = -block.vx[n]; }
+        if (block.x[n] > length) { block.x[n] = 2 * length - block.x[n]; block.vx[n] = -block.vx[n]; }
+        if (block.y[n] < 0) { block.y[n] = -block.y[n]; block.vy[n] = -block.vy[n]; }
+        if (block.y[n] > length) { block.y[n] = 2 * length - block.y[n]; block.vy[n] = -block.vy[n]; }
+    }
+}
+
+//In SI units, the block is in the given units
+template<typename T>
+double getKineticEnergy(const BasicParticleBlock<T> &block, double weight, const UnitSystem &units) {
+    double result = 0;
+    for (size_t n = 0; n < block.size(); n++) {
+        double vx = block.vx[n], vy = block.vy[n], vz = block.vz[n];
+        result += 0.5 * block.mass * weight * (vx * vx + vy * vy + vz * vz);
+    }
+    return result * units.mass * units.getVelocity() * units.getVelocity();
+}
+
+double getFieldEnergy(const Vector2D<double> &Ex, const Vector2D<double> &Ey, const Mesh &mesh) {
+    double result = 0;
+    for (uint i = 0; i < mesh.size; i++) {
+        for (uint j = 0; j < mesh.size; j++) {
+            result += 0.5 * epsilon0 * (Ex[{i, j}] * Ex[{i, j}] + Ey[{i, j}] * Ey[{i, j}]) * mesh.step * mesh.step;
+        }
+    }
+    return result;
+}
+
+//All the arrays of the block except indices, the order is the same for writing and reading a checkpoint
+template<typename T>
+std::vector<std::vector<T> *> getBlockArrays(BasicParticleBlock<T> &block) {
+    return {&block.x, &block.y, &block.z, &block.vx, &block.vy, &block.vz, &block.previousVx, &block.previousVy,
+            &block.previousVz, &block.ux, &block.uy, &block.uz, &block.gamma};
+}
+
+//Electron plasma oscillation in a grounded box with a uniform neutralizing ion background
+//Usage: Pic [restart]
+//A snapshot is written every checkpointAfterSteps steps, restart continues from the last one
+int main(int argc, char *argv[]) {
+    const double electronMass = 9.10938356e-31;
+    const double electronCharge = -1.60217662e-19;
+    const double density = 1e12;
+    const Mesh mesh{65, 1.5e-3};
+    const double length = mesh.length();
+    const Interval side{0, length};
+    const size_t particleCount = 200000;
+    const double weight = density * length * length / particleCount;
+    const double plasmaFrequency = std::sqrt(density * electronCharge * electronCharge / (epsilon0 * electronMass));
+    const double cellCharge = electronCharge * weight / (mesh.step * mesh.step);
+
+    double time = 0;
+    int step = 0;
+    double timeStep = 0.05 / plasmaFrequency;
+    double finalTime = 10 * 2 * M_PI / plasmaFrequency;
+    int printCount = 400;
+    auto steps = (int) std::round(finalTime / timeStep);
+    int printAfterSteps = std::max(1, steps / printCount);
+    double omega = 1.9;
+    const Vector B = {0, 0, 0};
+
+    //The particles are sorted by their mesh cell so the deposition and the gather walk the mesh in order
+    int sortAfterSteps = 50;
+    const uint32_t sortBits = 6;
+    int checkpointAfterSteps = 500;
+    const std::string checkpointFilename = "data/pic_checkpoint.bin";
+    const std::string energyFilename = "data/pic_energy.csv";
+    bool restart = argc > 1 && std::string(argv[1]) == "restart";
+
+    //The particles are pushed in units of one time step and one mesh step and stored as Scalar, see units.h.
+    //The field solve stays in SI, the fields are converted when they are gathered to the particles.
+    const auto units = UnitSystem::forSpecies(electronMass, electronCharge, timeStep, mesh.step);
+    const Mesh particleMesh{mesh.size, mesh.step / units.length};
+    const Interval particleSide{0, length / units.length};
+    auto block = toScaled<Scalar>(ParticleBlock(electronMass, electronCharge), units);
+    Vector2D<double> phi(mesh.size), rightHand(mesh.size), rho(mesh.size), Ex(mesh.size), Ey(mesh.size);
+    long sorSweeps = 0;
+
+    if (restart) {
+        //The particles, the potential the next SOR solve starts from, time, step and sweeps so far
+        CheckpointReader checkpoint(checkpointFilename);
+        uint64_t energyFileSize = 0;
+        checkpoint.read(time);
+        checkpoint.read(step);
+        checkpoint.read(sorSweeps);
+        for (auto array : getBlockArrays(block)) checkpoint.read(*array);
+        checkpoint.read(block.indices);
+        checkpoint.read(phi.getValues());
+        checkpoint.read(energyFileSize);
+        truncateOutput(energyFilename, energyFileSize);
+    } else {
+        auto particles = generateInRectangle(particleCount, side, side, electronMass);
+        setThermalVelocities(particles, 11600);
+        for (auto &particle : particles) {
+            particle.charge = electronCharge;
+            particle.velocity.z = 0;
+            //Sinusoidal displacement excites the oscillation
+            particle.position.x += 0.01 * length * std::sin(2 * M_PI * particle.position.x / length);
+        }
+        block = toScaled<Scalar>(splitBySpecies(particles).front(), units);
+    }
+
+    //see DiagnosticsWriter
+    DiagnosticsWriter writer;
+    auto energyStream = writer.open(energyFilename, std::numeric_limits<double>::max_digits10, restart);
+
+    std::vector<Scalar> particleEx(block.size()), particleEy(block.size()), particleEz(block.size());
+    const auto scaledTimeStep = timeStep / units.time;
+    const auto scaledB = units.scaleMagneticField(B);
+    const double ionDensity = -electronCharge * density;
+
+    auto start = std::chrono::high_resolution_clock::now();
+
+    while (time < finalTime) {
+        if (step % sortAfterSteps == 0) sortByMortonKey(block, particleSide, particleSide, sortBits);
+
+        //main routine
+        //Deposit the charge, solve the Poisson equation laplace(phi) = -rho/epsilon0 starting from the previous phi,
+        //compute E on the grid, gather it to the particles and push them
+        rho = Vector2D<double>(mesh.size);
+        depositCharge(block, cellCharge, particleMesh, rho);
+        for (uint i = 0; i < mesh.size; i++) {
+            for (uint j = 0; j < mesh.size; j++) {
+                rightHand[{i, j}] = -(rho[{i, j}] + ionDensity) / epsilon0;
+            }
+        }
+        sorSweeps += sorIterate(mesh.step, omega, phi, rightHand);
+        computeField(phi, mesh, Ex, Ey);
+        gatherField(block, particleMesh, Ex, Ey, units.getElectricField(), particleEx, particleEy);
+        borisUpdateVelocity(block, scaledTimeStep, particleEx, particleEy, particleEz, scaledB);
+        updatePositions(block, scaledTimeStep);
+        applyReflectingBorderCondition(block, (Scalar) particleSide.end);
+
+        if (step % printAfterSteps == 0) {
+            writer.write(energyStream, {time, getKineticEnergy(block, weight, units), getFieldEnergy(Ex, Ey, mesh)});
+        }
+
+        time += timeStep;
+        step++;
+
+        if (step % checkpointAfterSteps == 0) {
+            CheckpointWriter checkpoint(checkpointFilename);
+            checkpoint.write(time);
+            checkpoint.write(step);
+            checkpoint.write(sorSweeps);
+            for (auto array : getBlockArrays(block)) checkpoint.write(*array);
+            checkpoint.write(block.indices);
+            checkpoint.write(phi.getValues());
+            checkpoint.write(writer.getSize(energyStream));
+            checkpoint.commit();
+        }
+    }
+
+    auto end = std::chrono::high_resolution_clock::now();
+    auto nanosecondDuration = std::chrono::duration_cast<std::chrono::nanoseconds>(end - start).count();
+    auto duration = nanosecondDuration * 1e-9;
+
+    std::cout << "Execution took: " << duration << "s, average SOR sweeps per step: " << (double) sorSweeps / step
+              << std::endl;
+    PROFILE_REPORT(duration, "data/pic_profile.json");
+}
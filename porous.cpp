@@ -1,146 +1,394 @@
 #include <fstream>
 #include <vector>
-#include <queue>
 #include <random>
+#include <string>
+#include <iostream>
+#include <stdexcept>
+#include <algorithm>
+#include <numeric>
+#include <cmath>
+#include "porous.h"
+#include "ensemble.h"
 
-struct Node {
-    int i, j;
-
-    std::vector<Node> getNeighbours() const {
-        std::vector<Node> result;
-        result.emplace_back(Node{i + 1, j});
-        result.emplace_back(Node{i, j + 1});
-        result.emplace_back(Node{i - 1, j});
-        result.emplace_back(Node{i, j - 1});
-        return result;
-    };
-};
-
-class Que {
+//Union-find over cluster labels, each root keeps the cluster size and whether the cluster touches the first row
+class LabelForest {
 public:
-    void add(const std::vector<Node> &nodes) {
-        for (const auto &node : nodes) {
-            storedNodes.emplace(node);
+    int add(uint64_t size, bool touchesTop) {
+        parents.emplace_back(parents.size());
+        sizes.emplace_back(size);
+        tops.emplace_back(touchesTop);
+        return (int) parents.size() - 1;
+    }
+
+    int find(int label) {
+        while (parents[label] != label) {
+            parents[label] = parents[parents[label]];
+            label = parents[label];
         }
+        return label;
     }
 
-    bool isEmpty() {
-        return storedNodes.empty();
+    int unite(int a, int b) {
+        a = find(a);
+        b = find(b);
+        if (a == b) return a;
+        if (sizes[a] < sizes[b]) std::swap(a, b);
+        parents[b] = a;
+        sizes[a] += sizes[b];
+        tops[a] = tops[a] || tops[b];
+        return a;
     }
 
-    Node pop() {
-        Node result = storedNodes.front();
-        storedNodes.pop();
-        return result;
+    void clear() {
+        parents.clear();
+        sizes.clear();
+        tops.clear();
     }
 
-private:
-    std::queue<Node> storedNodes;
+    std::vector<int> parents;
+    std::vector<uint64_t> sizes;
+    std::vector<bool> tops;
 };
 
-class Grid {
-public:
-    Grid(uint width, uint height) : width(width), height(height), blocked(width * height), visited(width * height) {}
+struct ClusterStatistics {
+    bool spans = false;
+    uint64_t spanningMass = 0; //number of sites in clusters connecting the first and the last row
+    uint64_t clusterCount = 0;
+    uint64_t largestCluster = 0;
+    std::vector<uint64_t> sizeHistogram = std::vector<uint64_t>(64); //bin k counts clusters with size in [2^k, 2^(k+1))
 
-    std::vector<Node> firstRow() const {
-        std::vector<Node> result;
-        result.reserve(this->width);
-        for (int i = 0; i < this->width; i++) {
-            result.emplace_back(Node{i, 0});
-        }
-        return result;
+    void addCluster(uint64_t size) {
+        clusterCount++;
+        largestCluster = std::max(largestCluster, size);
+        int bin = 0;
+        while (size >>= 1u) bin++;
+        sizeHistogram[bin]++;
     }
+};
 
-    bool hasInLastRow(const Node &node) const {
-        return node.j == this->height - 1;
-    }
+//Hoshen-Kopelman labeling of the open sites, the lattice is generated row by row and only labels
+//of the previous and the current row are kept, memory is O(width) regardless of the height.
+//Sites are blocked with blockedProbability the same way as in Grid::fillRandomly, including the order of the random
+//numbers, and like pathExists(Grid &) the first row is the inlet, all of its sites are passable.
+ClusterStatistics hoshenKopelman(uint width, uint height, double blockedProbability, std::mt19937 &generator) {
+    std::uniform_real_distribution<> distribution{0, 1};
+    std::vector<int> previousRow(width, -1);
+    std::vector<int> currentRow(width, -1);
+    std::vector<int> compactLabels;
+    LabelForest forest;
+    LabelForest nextForest;
+    ClusterStatistics statistics;
 
-    std::vector<Node> getExplorableNeighbours(const Node &node) const {
-        std::vector<Node> result;
-        for (const auto &neighbour : node.getNeighbours()) {
-            if (!isOutside(neighbour) &&
-                !isBlocked(neighbour) &&
-                !isVisited(neighbour)) {
-                result.emplace_back(neighbour);
+    for (uint j = 0; j < height; j++) {
+        //main routine
+        //Label the row, labels 0..forest.parents.size() are the clusters carried from the previous row
+        for (uint i = 0; i < width; i++) {
+            if (distribution(generator) < blockedProbability && j > 0) {
+                currentRow[i] = -1;
+                continue;
+            }
+            auto left = i > 0 ? currentRow[i - 1] : -1;
+            auto up = previousRow[i];
+            int label;
+            if (left < 0 && up < 0) {
+                label = forest.add(0, j == 0);
+            } else if (left < 0) {
+                label = forest.find(up);
+            } else if (up < 0) {
+                label = forest.find(left);
+            } else {
+                label = forest.unite(left, up);
             }
+            forest.sizes[label]++;
+            currentRow[i] = label;
         }
-        return result;
-    }
 
-    void markAsVisited(const std::vector<Node> &nodes) {
-        for (const auto &node : nodes)
-            visited[node.i + node.j * this->width] = true;
+        //Clusters not reaching the current row are finished, the rest is relabeled to 0..k-1 for the next row
+        compactLabels.assign(forest.parents.size(), -1);
+        nextForest.clear();
+        for (uint i = 0; i < width; i++) {
+            if (currentRow[i] < 0) continue;
+            auto root = forest.find(currentRow[i]);
+            if (compactLabels[root] < 0) {
+                compactLabels[root] = nextForest.add(forest.sizes[root], forest.tops[root]);
+            }
+            currentRow[i] = compactLabels[root];
+        }
+        for (int label = 0; label < (int) forest.parents.size(); label++) {
+            if (forest.parents[label] == label && compactLabels[label] < 0) {
+                statistics.addCluster(forest.sizes[label]);
+            }
+        }
+        std::swap(forest, nextForest);
+        std::swap(previousRow, currentRow);
     }
 
-    void fillRandomly(double probability) {
-        this->clear();
-        for (auto &&isBlocked : this->blocked) {
-            isBlocked = distribution(generator) < probability;
+    //Clusters present in the last row span the lattice if they also touch the first row
+    for (int label = 0; label < (int) forest.parents.size(); label++) {
+        statistics.addCluster(forest.sizes[label]);
+        if (forest.tops[label]) {
+            statistics.spans = true;
+            statistics.spanningMass += forest.sizes[label];
         }
     }
+    return statistics;
+}
 
-private:
-    uint width, height;
-    std::vector<bool> blocked;
-    std::vector<bool> visited;
-    std::random_device randomDevice;
-    std::mt19937 generator{randomDevice()};
-    std::uniform_real_distribution<> distribution{0, 1};
-
-    bool isBlocked(const Node &node) const {
-        return blocked[node.i + node.j * this->width];
+double estimatePassProbabilityStreaming(
+        uint width,
+        uint height,
+        double blockedProbability,
+        std::mt19937 &generator,
+        int sampleCount = 100
+) {
+    int existCount = 0;
+    for (int i = 0; i < sampleCount; i++) {
+        //main routine
+        //see hoshenKopelman
+        if (hoshenKopelman(width, height, blockedProbability, generator).spans) existCount++;
     }
+    return (double) existCount / sampleCount;
+}
 
-    bool isVisited(const Node &node) const {
-        return visited[node.i + node.j * this->width];
-    }
+//Newman-Ziff - open the sites of an initially blocked lattice one by one in random order and record
+//the number of open sites at which the first and the last row get connected, one value per sample.
+//Like pathExists(Grid &) the first row is the inlet, its sites are open from the start and are not counted.
+std::vector<uint> newmanZiff(uint width, uint height, int sampleCount, std::mt19937 &generator) {
+    const uint siteCount = width * height;
+    const int top = (int) siteCount, bottom = (int) siteCount + 1;
+    std::vector<uint> order(siteCount - width);
+    std::vector<bool> open(siteCount);
+    std::vector<uint> spanningOccupancies;
+    LabelForest forest;
+
+    //Open site and merge it with the open neighbours (and the virtual top and bottom nodes)
+    auto openSite = [&](uint site) {
+        auto i = site % width, j = site / width;
+        open[site] = true;
+        if (j == 0) forest.unite((int) site, top);
+        if (j == height - 1) forest.unite((int) site, bottom);
+        if (i > 0 && open[site - 1]) forest.unite((int) site, (int) site - 1);
+        if (i < width - 1 && open[site + 1]) forest.unite((int) site, (int) site + 1);
+        if (j > 0 && open[site - width]) forest.unite((int) site, (int) (site - width));
+        if (j < height - 1 && open[site + width]) forest.unite((int) site, (int) (site + width));
+    };
+
+    for (int sample = 0; sample < sampleCount; sample++) {
+        std::iota(order.begin(), order.end(), width);
+        std::shuffle(order.begin(), order.end(), generator);
+        std::fill(open.begin(), open.end(), false);
+        forest.clear();
+        for (uint site = 0; site < siteCount + 2; site++) forest.add(1, false);
+        for (uint site = 0; site < width; site++) openSite(site);
+        if (forest.find(top) == forest.find(bottom)) {
+            spanningOccupancies.emplace_back(0);
+            continue;
+        }
 
-    bool isOutside(const Node &node) const {
-        return node.i < 0 || node.i >= width || node.j < 0 || node.j >= height;
+        //main routine
+        for (uint n = 0; n < order.size(); n++) {
+            openSite(order[n]);
+            if (forest.find(top) == forest.find(bottom)) {
+                spanningOccupancies.emplace_back(n + 1);
+                break;
+            }
+        }
     }
+    std::sort(spanningOccupancies.begin(), spanningOccupancies.end());
+    return spanningOccupancies;
+}
 
-    void clear(){
-        std::fill(blocked.begin(), blocked.end(), false);
-        std::fill(visited.begin(), visited.end(), false);
+//Convolve the fixed occupancy pass probability Q(n) = P(spanningOccupancy <= n) with the binomial
+//distribution of the open sites count, each site being open with probability 1 - blockedProbability
+double passProbabilityFromOccupancies(
+        const std::vector<uint> &sortedSpanningOccupancies,
+        uint siteCount,
+        double blockedProbability
+) {
+    auto passAt = [&](uint openCount) {
+        auto spanning = std::upper_bound(sortedSpanningOccupancies.begin(), sortedSpanningOccupancies.end(), openCount);
+        return (double) (spanning - sortedSpanningOccupancies.begin()) / sortedSpanningOccupancies.size();
+    };
+    auto openProbability = 1 - blockedProbability;
+    if (openProbability <= 0) return passAt(0);
+    if (openProbability >= 1) return passAt(siteCount);
+
+    //Only terms within 10 standard deviations from the mean are relevant
+    auto mean = siteCount * openProbability;
+    auto deviation = std::sqrt(siteCount * openProbability * blockedProbability);
+    auto from = (uint) std::max(0.0, std::floor(mean - 10 * deviation - 1));
+    auto to = (uint) std::min((double) siteCount, std::ceil(mean + 10 * deviation + 1));
+    double result = 0;
+    for (uint n = from; n <= to; n++) {
+        auto logBinomial = std::lgamma(siteCount + 1.0) - std::lgamma(n + 1.0) - std::lgamma(siteCount - n + 1.0) +
+                           n * std::log(openProbability) + (siteCount - n) * std::log(blockedProbability);
+        result += std::exp(logBinomial) * passAt(n);
     }
+    return result;
+}
+
+struct ThresholdEstimate {
+    uint size;
+    double threshold;
+    double error;
+    long solves;
 };
 
-//main routine
-bool pathExists(Grid &grid) {
-    Que que;
-    que.add(grid.firstRow());
-    while (!que.isEmpty()) {
-        auto currentNode = que.pop(); //Take one node from the que
-        if (grid.hasInLastRow(currentNode)) //if the currentNode is in the last row we reached the destination and the path exists
-            return true;
-        //Add valid neighbours to the que (!isOutside(neighbour) the grid && !isBlocked(neighbour) (being set randomly) &&!isVisited(neighbour) alreadyVisited by the algorithm)
-        auto neighbours = grid.getExplorableNeighbours(currentNode);
-        grid.markAsVisited(neighbours);
-        que.add(neighbours);
+//Find the blocked probability where the pass probability is 1/2 on a size x size lattice by the Robbins-Monro
+//stochastic approximation, p moves up if a path exists and down otherwise, with a decreasing step.
+//Every replica averages the second half of its iterates, the spread of the replicas gives the error.
+ThresholdEstimate estimateThreshold(
+        uint size,
+        std::seed_seq &seeds,
+        double initialGuess = 0.5,
+        int replicaCount = 10,
+        int stepsCount = 100,
+        double gain = 0.1
+) {
+    Grid grid(size, size);
+    grid.seed(seeds);
+    std::vector<double> replicaThresholds;
+    for (int replica = 0; replica < replicaCount; replica++) {
+        double blockedProbability = initialGuess;
+        double sum = 0;
+        for (int n = 0; n < stepsCount; n++) {
+            grid.fillRandomly(blockedProbability);
+            //main routine
+            //see pathExists
+            auto passed = pathExists(grid) ? 1.0 : 0.0;
+            blockedProbability += gain / std::pow(n + 1, 0.7) * (passed - 0.5);
+            blockedProbability = std::min(1.0, std::max(0.0, blockedProbability));
+            if (n >= stepsCount / 2) sum += blockedProbability;
+        }
+        replicaThresholds.emplace_back(sum / (stepsCount - stepsCount / 2));
     }
-    return false;
+    auto mean = std::accumulate(replicaThresholds.begin(), replicaThresholds.end(), 0.0) / replicaCount;
+    double variance = 0;
+    for (auto threshold : replicaThresholds) variance += (threshold - mean) * (threshold - mean);
+    variance /= replicaCount - 1;
+    return {size, mean, std::sqrt(variance / replicaCount), (long) replicaCount * stepsCount};
 }
 
-double estimatePassProbability(Grid& grid, double blockedProbability, int sampleCount = 100){
-    int existCount = 0;
-    for (int i = 0; i < sampleCount; i++){
-        grid.fillRandomly(blockedProbability);
+//Finite size scaling p_c(L) = p_c + A L^(-1/nu), weighted least squares fit of p_c and its error (nu = 4/3 in 2D)
+std::pair<double, double> extrapolateThreshold(const std::vector<ThresholdEstimate> &estimates, double nu = 4.0 / 3) {
+    double S = 0, Sx = 0, Sy = 0, Sxx = 0, Sxy = 0;
+    for (const auto &estimate : estimates) {
+        auto x = std::pow(estimate.size, -1 / nu);
+        auto weight = 1 / (estimate.error * estimate.error);
+        S += weight;
+        Sx += weight * x;
+        Sy += weight * estimate.threshold;
+        Sxx += weight * x * x;
+        Sxy += weight * x * estimate.threshold;
+    }
+    auto determinant = S * Sxx - Sx * Sx;
+    return {(Sxx * Sy - Sx * Sxy) / determinant, std::sqrt(Sxx / determinant)};
+}
 
-        //main routine
-        //see pathExists
-        if(pathExists(grid)) existCount++;
+//Pass probabilities of count + 1 blocked probabilities 0, step, ..., 1 saved as "p,probability" lines.
+//Each probability is an independent run of EnsembleRunner, estimate gets the seeds of the run, so the
+//curve depends only on seed.
+template<typename Estimate>
+void savePassProbabilities(int count, double step, uint32_t seed, std::ostream &file, Estimate estimate) {
+    EnsembleRunner ensemble(seed);
+    for (int i = 0; i <= count; i++) {
+        auto blockedProbability = i * step;
+        ensemble.add("pass probability", "", [=](RunContext &context) {
+            std::seed_seq seeds{context.seed};
+            context.output << blockedProbability << "," << estimate(blockedProbability, seeds) << std::endl;
+        });
     }
-    return (double) existCount / sampleCount;
+    std::vector<RunResult> results;
+    auto duration = timeIt([&]() { results = ensemble.run(); });
+    EnsembleRunner::printSummary(results, duration);
+    for (const auto &result : results) file << result.output;
 }
 
-int main() {
-    Grid grid(50, 50);
+//Usage: Porous [bfs|hk|nz|parallel|bits|threshold] [width] [height] [seed]
+//bfs - breadth first search on the whole Grid, deterministic for the given seed, see savePassProbabilities
+//hk - row streaming Hoshen-Kopelman on the same lattices as bfs, additionally saves cluster statistics of one lattice
+//at p = 0.4
+//nz - Newman-Ziff, the whole curve from one sweep per sample, deterministic for the given seed
+//parallel - bfs spread over threads, deterministic for the given seed
+//bits - bit packed lattice with word parallel flood fill, deterministic for the given seed
+//threshold - adaptive estimate of the critical blocked probability for several sizes, saved to porous_threshold.csv,
+//deterministic for the given seed
+int main(int argc, char *argv[]) {
+    std::string mode = argc > 1 ? argv[1] : "bfs";
+    uint width = argc > 2 ? std::stoul(argv[2]) : 50;
+    uint height = argc > 3 ? std::stoul(argv[3]) : width;
+    uint32_t seed = argc > 4 ? std::stoul(argv[4]) : 0;
+
+    if (mode == "threshold") {
+        std::vector<ThresholdEstimate> estimates;
+        double guess = 0.5;
+        std::ofstream thresholdFile("data/porous_threshold.csv");
+        for (uint size : {16, 32, 64, 128}) {
+            //Every size has its own stream, see estimatePassProbabilities
+            std::seed_seq seeds{seed, size};
+            estimates.emplace_back(estimateThreshold(size, seeds, guess));
+            const auto &estimate = estimates.back();
+            guess = estimate.threshold;
+            thresholdFile << estimate.size << "," << estimate.threshold << "," << estimate.error << ","
+                          << estimate.solves << std::endl;
+        }
+        auto threshold = extrapolateThreshold(estimates);
+        std::cout << "Critical blocked probability: " << threshold.first << " +/- " << threshold.second << std::endl;
+        return 0;
+    }
 
     uint count = 100;
     double step = 1.0 / count;
     std::ofstream file("data/porous.csv");
-    for (int i = 0; i <= count; i++){
-        auto blockedProbability = i * step;
-        file << blockedProbability << "," << estimatePassProbability(grid, blockedProbability) << std::endl;
+    if (mode == "bfs") {
+        savePassProbabilities(count, step, seed, file, [=](double blockedProbability, std::seed_seq &seeds) {
+            Grid grid(width, height);
+            grid.seed(seeds);
+            return estimatePassProbability(grid, blockedProbability);
+        });
+    } else if (mode == "hk") {
+        //Draws the same lattices as bfs, the curves are equal for the same seed
+        savePassProbabilities(count, step, seed, file, [=](double blockedProbability, std::seed_seq &seeds) {
+            std::mt19937 generator(seeds);
+            return estimatePassProbabilityStreaming(width, height, blockedProbability, generator);
+        });
+
+        std::mt19937 generator{seed};
+        auto statistics = hoshenKopelman(width, height, 0.4, generator);
+        std::ofstream clustersFile("data/porous_clusters.csv");
+        for (uint bin = 0; bin < statistics.sizeHistogram.size(); bin++) {
+            if (statistics.sizeHistogram[bin] > 0) {
+                clustersFile << (1ull << bin) << "," << statistics.sizeHistogram[bin] << std::endl;
+            }
+        }
+        std::cout << "Clusters: " << statistics.clusterCount << ", largest: " << statistics.largestCluster
+                  << ", spanning mass: " << statistics.spanningMass << std::endl;
+    } else if (mode == "bits") {
+        savePassProbabilities(count, step, seed, file, [=](double blockedProbability, std::seed_seq &seeds) {
+            BitGrid grid(width, height);
+            grid.seed(seeds);
+            return estimatePassProbability(grid, blockedProbability);
+        });
+    } else if (mode == "parallel") {
+        std::vector<double> blockedProbabilities;
+        for (int i = 0; i <= count; i++) blockedProbabilities.emplace_back(i * step);
+        //Each thread owns its Grid workspace
+        auto makeGrid = [=]() { return std::unique_ptr<Grid>(new Grid(width, height)); };
+        auto passProbabilities = estimatePassProbabilities(makeGrid, blockedProbabilities, seed);
+        for (int i = 0; i <= count; i++){
+            file << blockedProbabilities[i] << "," << passProbabilities[i] << std::endl;
+        }
+    } else if (mode == "nz") {
+        std::mt19937 generator{seed};
+        auto spanningOccupancies = newmanZiff(width, height, 100, generator);
+        //The sites of the first row are always passable, only the others are occupied at random
+        auto randomSiteCount = width * (height - 1);
+        for (int i = 0; i <= count; i++){
+            auto blockedProbability = i * step;
+            file << blockedProbability << ","
+                 << passProbabilityFromOccupancies(spanningOccupancies, randomSiteCount, blockedProbability) << std::endl;
+        }
+    } else {
+        throw std::invalid_argument("Unknown mode " + mode);
     }
 }
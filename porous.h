@@ -0,0 +1,329 @@
+#ifndef PMPL_POROUS_H
+#define PMPL_POROUS_H
+
+#include <vector>
+#include <queue>
+#include <random>
+#include <algorithm>
+#include <numeric>
+#include <cstdint>
+#include <memory>
+
+using uint = unsigned int;
+
+struct Node {
+    int i, j;
+
+    std::vector<Node> getNeighbours() const {
+        std::vector<Node> result;
+        result.emplace_back(Node{i + 1, j});
+        result.emplace_back(Node{i, j + 1});
+        result.emplace_back(Node{i - 1, j});
+        result.emplace_back(Node{i, j - 1});
+        return result;
+    };
+};
+
+class Que {
+public:
+    void add(const std::vector<Node> &nodes) {
+        for (const auto &node : nodes) {
+            storedNodes.emplace(node);
+        }
+    }
+
+    bool isEmpty() {
+        return storedNodes.empty();
+    }
+
+    Node pop() {
+        Node result = storedNodes.front();
+        storedNodes.pop();
+        return result;
+    }
+
+private:
+    std::queue<Node> storedNodes;
+};
+
+//Lattice of width x height sites searched breadth first node by node, see pathExists(Grid &)
+class Grid {
+public:
+    Grid(uint width, uint height) : width(width), height(height), blocked(width * height), visited(width * height) {}
+
+    void seed(std::seed_seq &seeds) {
+        generator.seed(seeds);
+    }
+
+    std::vector<Node> firstRow() const {
+        std::vector<Node> result;
+        result.reserve(this->width);
+        for (int i = 0; i < this->width; i++) {
+            result.emplace_back(Node{i, 0});
+        }
+        return result;
+    }
+
+    bool hasInLastRow(const Node &node) const {
+        return node.j == this->height - 1;
+    }
+
+    std::vector<Node> getExplorableNeighbours(const Node &node) const {
+        std::vector<Node> result;
+        for (const auto &neighbour : node.getNeighbours()) {
+            if (!isOutside(neighbour) &&
+                !isBlocked(neighbour) &&
+                !isVisited(neighbour)) {
+                result.emplace_back(neighbour);
+            }
+        }
+        return result;
+    }
+
+    void markAsVisited(const std::vector<Node> &nodes) {
+        for (const auto &node : nodes)
+            visited[node.i + node.j * this->width] = true;
+    }
+
+    void fillRandomly(double probability) {
+        this->clear();
+        for (auto &&isBlocked : this->blocked) {
+            isBlocked = distribution(generator) < probability;
+        }
+    }
+
+private:
+    uint width, height;
+    std::vector<bool> blocked;
+    std::vector<bool> visited;
+    std::random_device randomDevice;
+    std::mt19937 generator{randomDevice()};
+    std::uniform_real_distribution<> distribution{0, 1};
+
+    bool isBlocked(const Node &node) const {
+        return blocked[node.i + node.j * this->width];
+    }
+
+    bool isVisited(const Node &node) const {
+        return visited[node.i + node.j * this->width];
+    }
+
+    bool isOutside(const Node &node) const {
+        return node.i < 0 || node.i >= width || node.j < 0 || node.j >= height;
+    }
+
+    void clear(){
+        std::fill(blocked.begin(), blocked.end(), false);
+        std::fill(visited.begin(), visited.end(), false);
+    }
+};
+
+//main routine
+bool pathExists(Grid &grid) {
+    Que que;
+    que.add(grid.firstRow());
+    while (!que.isEmpty()) {
+        auto currentNode = que.pop(); //Take one node from the que
+        if (grid.hasInLastRow(currentNode)) //if the currentNode is in the last row we reached the destination and the path exists
+            return true;
+        //Add valid neighbours to the que (!isOutside(neighbour) the grid && !isBlocked(neighbour) (being set randomly) &&!isVisited(neighbour) alreadyVisited by the algorithm)
+        auto neighbours = grid.getExplorableNeighbours(currentNode);
+        grid.markAsVisited(neighbours);
+        que.add(neighbours);
+    }
+    return false;
+}
+
+//Rows of width sites stored as bits (1 bit per site), a row is wordsPerRow 64 bit words and bit k of word w is the
+//site 64w + k. The rows are numbered, the lattices arrange them in 2D or 3D, see BitGrid and BitGrid3D.
+class BitRows {
+public:
+    void seed(std::seed_seq &seeds) {
+        generator.seed(seeds);
+    }
+
+    //Compare raw 64 bit random numbers with probability * 2^64, much cheaper than a real distribution per site
+    void fillRandomly(double probability) {
+        const bool allBlocked = probability >= 1;
+        const auto threshold = allBlocked ? 0 : (uint64_t) (probability * 18446744073709551616.0);
+        for (size_t row = 0; row < rowCount; row++) {
+            for (uint w = 0; w < wordsPerRow; w++) {
+                uint64_t word = 0;
+                auto bits = std::min(64u, width - 64 * w);
+                for (uint k = 0; k < bits; k++) {
+                    auto isBlocked = allBlocked || generator() < threshold;
+                    word |= (uint64_t) !isBlocked << k;
+                }
+                open[w + row * wordsPerRow] = word;
+            }
+        }
+    }
+
+protected:
+    BitRows(uint width, size_t rowCount) :
+            width(width),
+            wordsPerRow((width + 63) / 64),
+            rowCount(rowCount),
+            open(wordsPerRow * rowCount),
+            reached(wordsPerRow * rowCount) {}
+
+    uint width, wordsPerRow;
+    size_t rowCount;
+    std::vector<uint64_t> open;
+    std::vector<uint64_t> reached;
+
+    //Spread reached bits of a word to the open bits connected to them by shifts and masks, log2(64) steps each way
+    static uint64_t fillWord(uint64_t reached, uint64_t open) {
+        auto up = reached & open, down = up;
+        auto upOpen = open, downOpen = open;
+        for (uint shift = 1; shift < 64; shift *= 2) {
+            up |= upOpen & (up << shift);
+            upOpen &= upOpen << shift;
+            down |= downOpen & (down >> shift);
+            downOpen &= downOpen >> shift;
+        }
+        return up | down;
+    }
+
+    //Spread reached sites along the row, left to right pass carries to the higher words and right to left
+    //to the lower ones
+    void spreadInRow(size_t row) {
+        auto reachedRow = &reached[row * wordsPerRow];
+        auto openRow = &open[row * wordsPerRow];
+        for (uint w = 0; w < wordsPerRow; w++) {
+            auto carry = w > 0 ? reachedRow[w - 1] >> 63u : 0;
+            reachedRow[w] = fillWord(reachedRow[w] | (carry & openRow[w]), openRow[w]);
+        }
+        for (uint w = wordsPerRow - 1; w-- > 0;) {
+            auto carry = (reachedRow[w + 1] & 1u) << 63u;
+            reachedRow[w] = fillWord(reachedRow[w] | (carry & openRow[w]), openRow[w]);
+        }
+    }
+
+    bool spreadFromRow(size_t from, size_t to) {
+        bool changed = false;
+        auto reachedFrom = &reached[from * wordsPerRow];
+        auto reachedTo = &reached[to * wordsPerRow];
+        auto openTo = &open[to * wordsPerRow];
+        for (uint w = 0; w < wordsPerRow; w++) {
+            auto word = reachedTo[w] | (reachedFrom[w] & openTo[w]);
+            if (word != reachedTo[w]) {
+                reachedTo[w] = word;
+                changed = true;
+            }
+        }
+        if (changed) spreadInRow(to);
+        return changed;
+    }
+
+    //Start of the flood fill, all the sites of the rows [from, to) even if blocked
+    void reachWholeRows(size_t from, size_t to) {
+        std::fill(reached.begin(), reached.end(), 0);
+        for (auto row = from; row < to; row++) {
+            for (uint w = 0; w < wordsPerRow; w++) {
+                auto bits = std::min(64u, width - 64 * w);
+                reached[w + row * wordsPerRow] = bits == 64 ? ~(uint64_t) 0 : ((uint64_t) 1 << bits) - 1;
+            }
+        }
+    }
+
+    //Whether any site of the rows from row on is reached
+    bool reachedFromRow(size_t row) const {
+        return std::any_of(reached.begin() + row * wordsPerRow, reached.end(), [](uint64_t word) { return word != 0; });
+    }
+
+private:
+    std::random_device randomDevice;
+    std::mt19937_64 generator{randomDevice()};
+};
+
+//Lattice of width x height sites stored as bits, row j is the row j of BitRows
+class BitGrid : public BitRows {
+public:
+    BitGrid(uint width, uint height) : BitRows(width, height), height(height) {}
+
+    //main routine
+    //Flood fill from the first row, rows are swept down and up until nothing new is reached.
+    //Like pathExists(Grid &) the first row is the inlet, all of its sites are reached even if blocked.
+    bool pathExists() {
+        reachWholeRows(0, 1);
+        bool changed = true;
+        while (changed) {
+            changed = false;
+            for (uint j = 1; j < height; j++) {
+                changed |= spreadFromRow(j - 1, j);
+            }
+            if (reachedFromRow(height - 1)) return true;
+            for (uint j = height - 1; j-- > 0;) {
+                changed |= spreadFromRow(j + 1, j);
+            }
+        }
+        return reachedFromRow(height - 1);
+    }
+
+private:
+    uint height;
+};
+
+bool pathExists(BitGrid &grid) {
+    return grid.pathExists();
+}
+
+//Fraction of sampleCount random lattices with a path from the first to the last row, see pathExists
+template<typename GridType>
+double estimatePassProbability(GridType &grid, double blockedProbability, int sampleCount = 100) {
+    int existCount = 0;
+    for (int i = 0; i < sampleCount; i++) {
+        grid.fillRandomly(blockedProbability);
+        //main routine
+        //see pathExists
+        if (pathExists(grid)) existCount++;
+    }
+    return (double) existCount / sampleCount;
+}
+
+//Samples of all the probabilities are split into tasks of samplesPerTask samples, each task seeds the grid
+//from (seed, probability index, task index) so the result does not depend on the threads count or scheduling.
+//Each thread owns one lattice, makeGrid returns it in a std::unique_ptr.
+template<typename MakeGrid>
+std::vector<double> estimatePassProbabilities(
+        const MakeGrid &makeGrid,
+        const std::vector<double> &blockedProbabilities,
+        uint32_t seed,
+        int sampleCount = 100,
+        int samplesPerTask = 10
+) {
+    const int tasksPerProbability = (sampleCount + samplesPerTask - 1) / samplesPerTask;
+    const long taskCount = (long) blockedProbabilities.size() * tasksPerProbability;
+    std::vector<int> existCounts(taskCount);
+
+    #pragma omp parallel
+    {
+        auto lattice = makeGrid();
+        auto &grid = *lattice;
+        #pragma omp for schedule(dynamic)
+        for (long task = 0; task < taskCount; task++) {
+            auto probabilityIndex = (uint32_t) (task / tasksPerProbability);
+            auto taskIndex = (uint32_t) (task % tasksPerProbability);
+            std::seed_seq seeds{seed, probabilityIndex, taskIndex};
+            grid.seed(seeds);
+
+            auto samples = std::min(samplesPerTask, sampleCount - (int) taskIndex * samplesPerTask);
+            for (int i = 0; i < samples; i++) {
+                grid.fillRandomly(blockedProbabilities[probabilityIndex]);
+                //main routine
+                //see pathExists
+                if (pathExists(grid)) existCounts[task]++;
+            }
+        }
+    }
+
+    std::vector<double> result;
+    for (uint i = 0; i < blockedProbabilities.size(); i++) {
+        auto first = existCounts.begin() + i * tasksPerProbability;
+        result.emplace_back((double) std::accumulate(first, first + tasksPerProbability, 0) / sampleCount);
+    }
+    return result;
+}
+
+#endif //PMPL_POROUS_H
@@ -0,0 +1,75 @@
+#include <fstream>
+#include <iostream>
+#include <vector>
+#include <random>
+#include <string>
+#include <memory>
+#include "porous.h"
+
+//Lattice of width x height x depth sites stored as bits, row (j, l) of BitRows is the row with y = j in the layer
+//z = l, the path is searched from the first layer to the last one.
+class BitGrid3D : public BitRows {
+public:
+    BitGrid3D(uint width, uint height, uint depth) :
+            BitRows(width, (size_t) height * depth),
+            height(height),
+            depth(depth) {}
+
+    //main routine
+    //Flood fill from the first layer, rows are swept forward (from y - 1 and z - 1)
+    //and backward (from y + 1 and z + 1) until nothing new is reached.
+    //The first layer is the inlet like the first row of pathExists(Grid &), all of its sites are reached.
+    bool pathExists() {
+        reachWholeRows(index(0, 0), index(0, 1));
+
+        bool changed = true;
+        while (changed) {
+            changed = false;
+            for (uint l = 0; l < depth; l++) {
+                for (uint j = 0; j < height; j++) {
+                    if (j > 0) changed |= spreadFromRow(index(j - 1, l), index(j, l));
+                    if (l > 0) changed |= spreadFromRow(index(j, l - 1), index(j, l));
+                }
+            }
+            if (reachedFromRow(index(0, depth - 1))) return true;
+            for (uint l = depth; l-- > 0;) {
+                for (uint j = height; j-- > 0;) {
+                    if (j < height - 1) changed |= spreadFromRow(index(j + 1, l), index(j, l));
+                    if (l < depth - 1) changed |= spreadFromRow(index(j, l + 1), index(j, l));
+                }
+            }
+        }
+        return reachedFromRow(index(0, depth - 1));
+    }
+
+private:
+    uint height, depth;
+
+    size_t index(uint j, uint l) const {
+        return (size_t) j + (size_t) l * height;
+    }
+};
+
+bool pathExists(BitGrid3D &grid) {
+    return grid.pathExists();
+}
+
+//Usage: Porous3D [size] [seed]
+int main(int argc, char *argv[]) {
+    uint size = argc > 1 ? std::stoul(argv[1]) : 64;
+    uint32_t seed = argc > 2 ? std::stoul(argv[2]) : 0;
+
+    uint count = 100;
+    double step = 1.0 / count;
+    std::vector<double> blockedProbabilities;
+    for (int i = 0; i <= count; i++) blockedProbabilities.emplace_back(i * step);
+
+    //Each thread owns one lattice, so the memory is threads * 2 bits per site, see estimatePassProbabilities
+    auto makeGrid = [=]() { return std::unique_ptr<BitGrid3D>(new BitGrid3D(size, size, size)); };
+    auto passProbabilities = estimatePassProbabilities(makeGrid, blockedProbabilities, seed, 100, 5);
+
+    std::ofstream file("data/porous3d.csv");
+    for (int i = 0; i <= count; i++){
+        file << blockedProbabilities[i] << "," << passProbabilities[i] << std::endl;
+    }
+}
@@ -27,3 +27,9 @@ if __name__ == '__main__':
     print(np.mean(data) - np.exp(-2*0.5)*np.cos(2*0.5))
     plt.savefig(path.join(loc, "../images/carlo_precision.png"))
 
+    plt.clf()
+
+    data = np.genfromtxt(path.join(loc, "../data/carlo_variance.csv"), delimiter=",", dtype=None, encoding=None)
+    print("method, std, walks for 1e-3 error, time per estimate")
+    for method, std, walks, duration in data:
+        print(method, std, int(walks), duration)
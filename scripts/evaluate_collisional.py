@@ -29,8 +29,8 @@ if __name__ == '__main__':
 
 
     def animate(j):
-        x = data[j, 1::(6 * 100)]
-        y = data[j, 2::(6 * 100)]
+        x = data[j, 1::6]
+        y = data[j, 2::6]
         line.set_data(x, y)
         title.set_text("Collisional gas, time {} s".format(data[j, 0]))
         return line, title
@@ -58,12 +58,10 @@ if __name__ == '__main__':
     plt.savefig(path.join(loc, '../images/collisional_energy.png'))
     plt.clf()
 
-    data = np.genfromtxt(path.join(loc, "../data/collisional_trajectories.csv"), delimiter=",")
-
-    j = -1
-    v_x = data[j, 4::6]
-    v_y = data[j, 5::6]
-    v_z = data[j, 6::6]
+    velocities = np.genfromtxt(path.join(loc, "../data/collisional_velocities.csv"), delimiter=",")
+    v_x = velocities[:, 0]
+    v_y = velocities[:, 1]
+    v_z = velocities[:, 2]
 
     speed = np.sqrt(np.power(v_x, 2) + np.power(v_y, 2) + np.power(v_z, 2))
 
@@ -10,12 +10,10 @@ matplotlib.use("Agg")
 if __name__ == '__main__':
     loc = pathlib.Path(__file__).parent.absolute()
     side_data = np.genfromtxt(path.join(loc, '../data/collisionless_side_speeds.csv'), delimiter=",")
-    data = np.genfromtxt(path.join(loc, "../data/collisionless_trajectories.csv"), delimiter=",")
-
-    j = -1
-    v_x = data[j, 4::6]
-    v_y = data[j, 5::6]
-    v_z = data[j, 6::6]
+    velocities = np.genfromtxt(path.join(loc, "../data/collisionless_velocities.csv"), delimiter=",")
+    v_x = velocities[:, 0]
+    v_y = velocities[:, 1]
+    v_z = velocities[:, 2]
 
     fig, axs = plt.subplots(2, 2, figsize=(11, 7))
     axs[0, 0].hist(v_x, density=True, bins=30, label="Volume $v_x$")
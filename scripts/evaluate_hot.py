@@ -29,8 +29,8 @@ if __name__ == '__main__':
 
 
     def animate(j):
-        x = data[j, 1::(6 * 100)]
-        y = data[j, 2::(6 * 100)]
+        x = data[j, 1::6]
+        y = data[j, 2::6]
         line.set_data(x, y)
         title.set_text("Hot background gas, time {} s".format(data[j, 0]))
         return line, title
@@ -43,10 +43,10 @@ if __name__ == '__main__':
     anim.save(path.join(loc, '../images/hot_trajectories.mp4'), writer=writer)
     plt.clf()
 
-    j = -1
-    v_x = data[j, 4::6]
-    v_y = data[j, 5::6]
-    v_z = data[j, 6::6]
+    velocities = np.genfromtxt(path.join(loc, "../data/hot_velocities.csv"), delimiter=",")
+    v_x = velocities[:, 0]
+    v_y = velocities[:, 1]
+    v_z = velocities[:, 2]
 
     speed = np.sqrt(np.power(v_x, 2) + np.power(v_y, 2) + np.power(v_z, 2))
 
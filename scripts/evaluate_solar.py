@@ -48,4 +48,15 @@ if __name__ == '__main__':
     plt.xlim([-1.53e8, -1.47e8])
     plt.ylim([-0.4e8, 0.4e8])
     plt.savefig(path.join(loc, "../images/solar_zoom.png"))
-    plt.clf()
\ No newline at end of file
+    plt.clf()
+    data = np.genfromtxt(path.join(loc, "../data/solar_integrators.csv"), delimiter=",")
+    plt.title("Symplectic integrators, 10 years")
+    plt.loglog(data[:, 2], data[:, 1], "o-", label="Leapfrog")
+    plt.loglog(data[:, 4], data[:, 3], "o-", label="Yoshida 4")
+    plt.loglog(data[:, 6], data[:, 5], "o-", label="Yoshida 6")
+    plt.legend()
+    plt.xlabel("Wall clock time [s]")
+    plt.ylabel("max $|\\Delta E / E|$ [-]")
+    plt.grid()
+    plt.savefig(path.join(loc, "../images/solar_integrators.png"))
+    plt.clf()
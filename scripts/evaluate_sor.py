@@ -22,7 +22,7 @@ if __name__ == '__main__':
         plt.clf()
 
     data = np.genfromtxt(path.join(loc, "../data/sor_optimization.csv"), delimiter=",")
-    if data:
+    if data.size:
         plt.plot(data[:, 0], data[:, 1])
 
         optimal_omega = 1
@@ -39,12 +39,16 @@ if __name__ == '__main__':
         plt.grid()
         plt.title("SOR optimization")
         plt.savefig(path.join(loc, "../images/sor_optimization.png"))
+        plt.clf()
 
     data = np.genfromtxt(path.join(loc, "../data/sor_time.csv"), delimiter=",")
     grid_size = data[:, 0]
     time = data[:, 1]
 
-    plt.plot(grid_size, time)
+    plt.plot(grid_size, time, label="From zero")
+    warm = np.genfromtxt(path.join(loc, "../data/sor_time_warm.csv"), delimiter=",")
+    plt.plot(warm[:, 0], warm[:, 1], label="Warm start")
+    plt.legend()
     plt.grid()
     plt.title("SOR simulation scaling")
     plt.xlabel("Grid size")
@@ -0,0 +1,34 @@
+import pathlib
+from os import path
+
+import numpy as np
+import matplotlib
+from matplotlib import pyplot as plt
+
+matplotlib.use("Agg")
+
+if __name__ == '__main__':
+    loc = pathlib.Path(__file__).parent.absolute()
+    # kind,processes,sizeX,sizeY,sweeps,duration,norm,serialSweeps,serialDuration
+    data = np.genfromtxt(path.join(loc, "../data/sor_mpi_scaling.csv"), delimiter=",", dtype=None, encoding=None)
+
+    for size in sorted({row[2] for row in data if row[0] == "strong"}):
+        rows = sorted([row for row in data if row[0] == "strong" and row[2] == size], key=lambda row: row[1])
+        processes = [row[1] for row in rows]
+        speedup = [row[8] / row[5] for row in rows]
+        plt.plot(processes, speedup, "o-", label="{0}x{0}".format(size))
+    plt.xlabel("Processes")
+    plt.ylabel("Speedup against scalingTest")
+    plt.grid()
+    plt.legend()
+    plt.title("Distributed SOR strong scaling")
+    plt.savefig(path.join(loc, '../images/sor_mpi_strong.png'))
+    plt.clf()
+
+    rows = sorted([row for row in data if row[0] == "weak"], key=lambda row: row[1])
+    plt.plot([row[1] for row in rows], [row[5] / row[4] for row in rows], "o-")
+    plt.xlabel("Processes")
+    plt.ylabel("Time per sweep [s]")
+    plt.grid()
+    plt.title("Distributed SOR weak scaling")
+    plt.savefig(path.join(loc, '../images/sor_mpi_weak.png'))
@@ -1,10 +1,13 @@
 #include "particles.h"
+#include "checkpoint.h"
 
 #include <iostream>
 #include <vector>
 #include <cmath>
 #include <limits>
 #include <chrono>
+#include <string>
+#include <algorithm>
 
 struct NewtonGravitationalLaw {
     Vector operator ()(const Particle& a, const Particle& b) const {
@@ -21,6 +24,21 @@ struct NewtonGravitationalLaw {
 };
 
 
+//Time derivative of NewtonGravitationalLaw
+struct NewtonGravitationalJerk {
+    Vector operator ()(const Particle& a, const Particle& b) const {
+        auto m_1 = a.mass;
+        auto m_2 = b.mass;
+        double G = 6.674e-20;
+        auto r = (b.position - a.position);
+        auto v = (b.velocity - a.velocity);
+        auto abs_r = r.getNorm();
+        auto r3 = abs_r*abs_r*abs_r;
+        auto rv = r.x*v.x + r.y*v.y + r.z*v.z;
+        return G * m_1 * m_2 / r3 * (v - 3 * rv / (abs_r*abs_r) * r);
+    }
+};
+
 struct NewtonPotentialEnergy {
     double operator ()(const Particle& a, const Particle& b) const {
         auto m_1 = a.mass;
@@ -33,6 +51,87 @@ struct NewtonPotentialEnergy {
     }
 };
 
+std::vector<Particle> getSolarSystem() {
+    Particle sun(1988500e24, {0,0}, {0,0});
+    Particle earth(5.9726e24, {147.09e6, 0}, {0,30.29});
+    Particle moon(0.07342e24, {147.09e6 + 0.3633e6, 0}, {0,30.29 + 1.076});
+    return {sun, earth, moon};
+}
+
+struct EnergyTestResult {
+    double maxEnergyError;
+    double duration;
+};
+
+//Run the integrator for finalTime and track the maximal relative energy error
+template<typename Integrator>
+EnergyTestResult energyTest(double timeStep, double finalTime) {
+    NewtonGravitationalLaw forceCalculator;
+    NewtonPotentialEnergy potentialCalculator;
+    Integrator integrator;
+    auto particles = getSolarSystem();
+    auto initialEnergy = getTotalPotentialEnergy(particles, potentialCalculator) + getTotalKineticEnergy(particles);
+    auto steps = (long) std::round(finalTime / timeStep);
+
+    double maxEnergyError = 0;
+    auto start = std::chrono::high_resolution_clock::now();
+    for (long step = 0; step < steps; step++) {
+        //main routine
+        //see SymplecticIntegrator in particles.h
+        integrator.step(particles, timeStep, forceCalculator);
+        auto energy = getTotalPotentialEnergy(particles, potentialCalculator) + getTotalKineticEnergy(particles);
+        maxEnergyError = std::max(maxEnergyError, std::abs((energy - initialEnergy) / initialEnergy));
+    }
+    auto end = std::chrono::high_resolution_clock::now();
+    auto duration = std::chrono::duration_cast<std::chrono::nanoseconds>(end - start).count() * 1e-9;
+    return {maxEnergyError, duration};
+}
+
+//Energy error against wall clock time of the leapfrog and its 4th and 6th order compositions for several steps
+void benchmarkIntegrators(const std::string &filename, double finalTime) {
+    std::ofstream file(filename);
+    file.precision(std::numeric_limits< double >::max_digits10);
+    for (double hours : {0.5, 1.0, 2.0, 4.0, 8.0, 16.0, 32.0}) {
+        auto timeStep = hours * 60 * 60;
+        auto second = energyTest<SymplecticIntegrator<2>>(timeStep, finalTime);
+        auto fourth = energyTest<SymplecticIntegrator<4>>(timeStep, finalTime);
+        auto sixth = energyTest<SymplecticIntegrator<6>>(timeStep, finalTime);
+        file << timeStep << ","
+             << second.maxEnergyError << "," << second.duration << ","
+             << fourth.maxEnergyError << "," << fourth.duration << ","
+             << sixth.maxEnergyError << "," << sixth.duration << std::endl;
+    }
+}
+
+//Block time step Hermite run synchronized every printStep, the Moon and the Earth take smaller steps than the Sun
+void runHermite(const std::string &filename, double finalTime, double printStep) {
+    NewtonGravitationalLaw forceCalculator;
+    NewtonGravitationalJerk jerkCalculator;
+    NewtonPotentialEnergy potentialCalculator;
+    auto particles = getSolarSystem();
+    HermiteIntegrator integrator(printStep, 0.003);
+
+    std::ofstream energyFile(filename);
+    energyFile.precision(std::numeric_limits< double >::max_digits10);
+    auto initialEnergy = getTotalPotentialEnergy(particles, potentialCalculator) + getTotalKineticEnergy(particles);
+
+    auto start = std::chrono::high_resolution_clock::now();
+    for (double time = printStep; time <= finalTime; time += printStep) {
+        //main routine
+        //see HermiteIntegrator in particles.h
+        integrator.advanceTo(particles, time, forceCalculator, jerkCalculator);
+        auto energy = getTotalPotentialEnergy(particles, potentialCalculator) + getTotalKineticEnergy(particles);
+        energyFile << time << "," << (energy - initialEnergy) / energy << std::endl;
+    }
+    auto end = std::chrono::high_resolution_clock::now();
+    auto duration = std::chrono::duration_cast<std::chrono::nanoseconds>(end - start).count() * 1e-9;
+
+    std::cout << "Hermite took: " << duration << "s, pair force evaluations: " << integrator.getForceEvaluations()
+              << std::endl;
+}
+
+//Usage: Solar [restart]
+//A snapshot is written every checkpointAfterSteps steps, restart continues from the last one
 int main(int argc, char* argv[]) {
     double time = 0;
     int step = 0;
@@ -41,24 +140,42 @@ int main(int argc, char* argv[]) {
     int printCount = 5000;
     auto steps = (int) std::round(finalTime/timeStep);
     int printAfterSteps = steps / printCount;
+    int checkpointAfterSteps = 1000;
+    const std::string checkpointFilename = "data/solar_checkpoint.bin";
+    const std::string energyFilename = "data/solar_energy.csv";
+    const std::string trajectoriesFilename = "data/solar_trajectories.csv";
+    bool restart = argc > 1 && std::string(argv[1]) == "restart";
 
     //Set how potential energy and force are calculated, see NewtonGravitationalLaw and NewtonPotentialEnergy
     NewtonGravitationalLaw forceCalculator;
     NewtonPotentialEnergy potentialCalculator;
 
-    Particle sun(1988500e24, {0,0}, {0,0});
-    Particle earth(5.9726e24, {147.09e6, 0}, {0,30.29});
-    Particle moon(0.07342e24, {147.09e6 + 0.3633e6, 0}, {0,30.29 + 1.076});
-
-    std::vector<Particle> particles = {sun, earth, moon};
+    std::vector<Particle> particles;
+    double initialEnergy = 0;
+
+    if (restart) {
+        CheckpointReader checkpoint(checkpointFilename);
+        checkpoint.read(time);
+        checkpoint.read(step);
+        checkpoint.read(initialEnergy);
+        checkpoint.read(particles);
+        for (const auto &filename : {energyFilename, trajectoriesFilename}) {
+            uint64_t size = 0;
+            checkpoint.read(size);
+            truncateOutput(filename, size);
+        }
+    } else {
+        particles = getSolarSystem();
+        initialEnergy = getTotalPotentialEnergy(particles, potentialCalculator) + getTotalKineticEnergy(particles);
+    }
 
-    std::ofstream energyFile("data/solar_energy.csv");
-    energyFile.precision(std::numeric_limits< double >::max_digits10);
+    //see DiagnosticsWriter
+    DiagnosticsWriter writer;
+    auto energyStream = writer.open(energyFilename, std::numeric_limits<double>::max_digits10, restart);
+    auto trajectoriesStream = writer.open(trajectoriesFilename, 6, restart);
 
     auto start = std::chrono::high_resolution_clock::now();
 
-    auto initialEnergy = getTotalPotentialEnergy(particles, potentialCalculator) + getTotalKineticEnergy(particles);
-
     while (time < finalTime){
         double potentialEnergy = 0;
         if (step % printAfterSteps == 0){
@@ -73,16 +190,28 @@ int main(int argc, char* argv[]) {
         updatePositions(particles, timeStep); //just x = v*t
 
         if (step % printAfterSteps == 0){
-            updateTrajectories(particles, time);
+            writeTrajectories(writer, trajectoriesStream, particles, time);
 
             auto kineticEnergy = getTotalKineticEnergy(particles);
             auto totalEnergy = potentialEnergy + kineticEnergy;
 
-            energyFile << time << "," << (totalEnergy - initialEnergy) / totalEnergy << std::endl;
+            writer.write(energyStream, {time, (totalEnergy - initialEnergy) / totalEnergy});
         }
 
         time += timeStep;
         step++;
+
+        if (step % checkpointAfterSteps == 0) {
+            CheckpointWriter checkpoint(checkpointFilename);
+            checkpoint.write(time);
+            checkpoint.write(step);
+            checkpoint.write(initialEnergy);
+            checkpoint.write(particles);
+            for (auto stream : {energyStream, trajectoriesStream}) {
+                checkpoint.write(writer.getSize(stream));
+            }
+            checkpoint.commit();
+        }
     }
 
     auto end = std::chrono::high_resolution_clock::now();
@@ -90,6 +219,8 @@ int main(int argc, char* argv[]) {
     auto duration = nanosecondDuration * 1e-9;
 
     std::cout << "Execution took: " << duration << "s." << std::endl;
+    PROFILE_REPORT(duration, "data/solar_profile.json");
 
-    saveTrajectories("data/solar_trajectories.csv", particles);
+    benchmarkIntegrators("data/solar_integrators.csv", 10.0 * 365 * 24 * 60 * 60);
+    runHermite("data/solar_hermite_energy.csv", finalTime, 2 * 24 * 60 * 60);
 }
@@ -1,146 +1,9 @@
-#include <vector>
 #include <cmath>
 #include <iostream>
-#include <sstream>
 #include <fstream>
 #include "utils.h"
-
-using uint = unsigned int;
-
-struct Index2D {
-    uint i, j;
-};
-
-template<typename T>
-class Vector2D {
-public:
-    explicit Vector2D(uint size) : Vector2D(size, size) {}
-
-    Vector2D(uint sizeX, uint sizeY) : sizeX(sizeX), sizeY(sizeY), values(sizeX * sizeY, 0) {}
-
-    T &operator[](const Index2D &index) {
-        return values[index.i + index.j * sizeX];
-    }
-
-    uint sizeX{}, sizeY{};
-
-private:
-    std::vector<T> values;
-
-    template<typename _T>
-    friend std::ostream &operator<<(std::ostream &os, Vector2D<_T> &vector);
-};
-
-template<typename T>
-std::ostream &operator<<(std::ostream &os, Vector2D<T> &vector) {
-    os << "[";
-    std::string lineSeparator;
-    for (uint j = 0; j < vector.sizeY; ++j) {
-        std::stringstream line;
-        std::string separator;
-        for (uint i = 0; i < vector.sizeX; ++i) {
-            line << separator << vector[{i, j}];
-            separator = ",";
-        }
-        os << lineSeparator << std::endl << "[" << line.str() << "]";
-        lineSeparator = ",";
-    }
-    os << "]";
-    return os;
-}
-
-double analyticFunction(double x, double y) {
-    return std::exp(-2 * x) * std::cos(2 * y);
-}
-
-bool isBorder(const Index2D &index, uint N) {
-    return index.i == 0 || index.j == 0 || index.i == N - 1 || index.j == N - 1;
-}
-
-std::string linspaceString(uint size, double step) {
-    std::stringstream result;
-    std::string separator;
-
-    result << "[";
-    for (uint i = 0; i < size; ++i) {
-        result << separator << i * step;
-        separator = ",";
-    }
-    result << "]";
-    return result.str();
-}
-
-template<typename T>
-struct SorResult {
-    std::string json;
-    double norm{};
-    uint steps{};
-    Vector2D<T> function{0};
-};
-
-template<typename T>
-SorResult<T> sor(double step, double omega, const Vector2D<T> &initial, const Vector2D<T> &rightHand) {
-    auto phi = initial;
-    auto r = rightHand;
-    double maxResidual = 0;
-    uint steps = 0;
-    do {
-        steps++;
-        maxResidual = 0;
-        for (uint i = 1; i < phi.sizeX - 1; i++) {
-            for (uint j = 1; j < phi.sizeY - 1; j++) {
-                //main routine
-                //SOR step
-                auto currentResidual =
-                        -4 * phi[{i, j}] + phi[{i - 1, j}] + phi[{i + 1, j}] + phi[{i, j - 1}] + phi[{i, j + 1}] -
-                        r[{i, j}] * step * step;
-                phi[{i, j}] = phi[{i, j}] + omega * 1.0 / 4 * currentResidual;
-                if (std::abs(currentResidual) > maxResidual) maxResidual = std::abs(currentResidual);
-            }
-        }
-    } while (maxResidual > 1e-5 * step * step); // maxResidual is max(|residual|)
-
-    double norm = 0;
-    for (uint i = 1; i < phi.sizeX - 1; i++) {
-        for (uint j = 1; j < phi.sizeY - 1; j++) {
-            norm += std::abs(phi[{i, j}] - analyticFunction(i * step, j * step)) * step * step;
-        }
-    }
-
-    std::stringstream json;
-    json << "{\"phi\":" << phi << "," << std::endl;
-    json << "\"x\":" << linspaceString(phi.sizeX, step) << "," << std::endl;
-    json << "\"y\":" << linspaceString(phi.sizeY, step) << "}" << std::endl;
-
-    return {json.str(), norm, steps, phi};
-}
-
-struct ScalingTestResult {
-    double duration;
-    double potential;
-    SorResult<double> sorResult;
-};
-
-ScalingTestResult scalingTest(uint gridSize, double omega = 1.84){
-    SorResult<double> result;
-
-    Vector2D<double> phi(gridSize);
-    Vector2D<double> r(gridSize);
-    double step = 1.0 / (gridSize - 1);
-
-    //Set border values, could be anything, eg. 2 electrodes
-    for (uint i = 0; i < gridSize; i++) {
-        for (uint j = 0; j < gridSize; j++) {
-            if (isBorder({i, j}, gridSize)) {
-                phi[{i, j}] = analyticFunction(i * step, j * step);
-            }
-        }
-    }
-    auto duration = timeIt([&]() {
-        result = sor(step, omega, phi, r);
-    });
-    return {duration, result.function[{(gridSize - 1) / 2, (gridSize - 1) / 2}], result};
-}
+#include "sor.h"
+#include "ensemble.h"
 
 int main() {
     uint N = 201; //nodes
@@ -156,23 +19,62 @@ int main() {
         }
     }
 
-    uint samples = 0;
-    std::ofstream optimization("data/sor_optimization.csv");
+    //Each omega is an independent run, see EnsembleRunner. The buffers of the runs are saved in the order they
+    //were added.
+    //The runs start from zero (no SorCache) as the sweep counts and the times are what is compared
+    uint samples = 20;
+    EnsembleRunner ensemble;
     for (int i = 1; i < samples; i++) {
         double omega = 1 + (1.0 / samples) * i;
-        auto result = sor(step, omega, phi, r);
-        optimization << omega << "," << result.steps << std::endl;
+        ensemble.add("sor omega", "", [&, omega](RunContext &context) {
+            auto result = sor(step, omega, phi, r);
+            context.output << omega << "," << result.steps << std::endl;
+        });
     }
+    std::vector<RunResult> results;
+    auto duration = timeIt([&]() { results = ensemble.run(); });
+    EnsembleRunner::printSummary(results, duration);
+    std::ofstream optimization("data/sor_optimization.csv");
+    for (const auto &result : results) optimization << result.output;
 
+    //The durations are compared with the warm start below and with carlo, so the grid sizes are timed one after
+    //another on a single worker
+    EnsembleRunner scaling(0, 1);
+    for (int gridSize = 20; gridSize < 202; gridSize=gridSize+2){
+        scaling.add("sor scaling", "", [gridSize](RunContext &context) {
+            auto result = scalingTest(gridSize);
+            context.output << gridSize << "," << result.duration << std::endl;
+        });
+    }
+    duration = timeIt([&]() { results = scaling.run(); });
+    EnsembleRunner::printSummary(results, duration);
     std::ofstream timeFile("data/sor_time.csv");
+    for (const auto &result : results) timeFile << result.output;
+
+    //Same grids one after another, every solve starts from the previous solution interpolated onto its grid,
+    //see SorCache
+    SorCache<double> cache;
+    std::ofstream warmTimeFile("data/sor_time_warm.csv");
     for (int gridSize = 20; gridSize < 202; gridSize=gridSize+2){
-        auto result = scalingTest(gridSize);
-        timeFile << gridSize << "," << result.duration << std::endl;
+        auto result = scalingTest(gridSize, 1.84, &cache);
+        warmTimeFile << gridSize << "," << result.duration << "," << result.sorResult.steps << std::endl;
     }
 
     auto test = scalingTest(202);
     std::cout << test.potential - analyticFunction(0.5,0.5) << std::endl;
 
+    //Nested iteration, the grid 202 from the coarser solutions 26 -> 51 -> 101, compared with test from zero
+    SorCache<double> nestedCache;
+    uint nestedSteps = 0;
+    double nestedDuration = 0;
+    for (uint gridSize : {26u, 51u, 101u, 202u}) {
+        auto result = scalingTest(gridSize, 1.84, &nestedCache);
+        nestedSteps = result.sorResult.steps;
+        nestedDuration += result.duration;
+    }
+    std::cout << "From zero: " << test.sorResult.steps << " sweeps, " << test.duration << "s. Nested iteration: "
+              << nestedSteps << " sweeps on the finest grid, " << nestedDuration << "s in total." << std::endl;
+
     std::ofstream sorFile("data/sor.json");
     sorFile << test.sorResult.json;
 }
\ No newline at end of file
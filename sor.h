@@ -0,0 +1,253 @@
+#ifndef PMPL_SOR_H
+#define PMPL_SOR_H
+
+#include <vector>
+#include <cmath>
+#include <string>
+#include <sstream>
+#include <iostream>
+#include <algorithm>
+#include <utility>
+#include "utils.h"
+
+using uint = unsigned int;
+
+struct Index2D {
+    uint i, j;
+};
+
+template<typename T>
+class Vector2D {
+public:
+    explicit Vector2D(uint size) : Vector2D(size, size) {}
+
+    Vector2D(uint sizeX, uint sizeY) : sizeX(sizeX), sizeY(sizeY), values(sizeX * sizeY, 0) {}
+
+    T &operator[](const Index2D &index) {
+        return values[index.i + index.j * sizeX];
+    }
+
+    const T &operator[](const Index2D &index) const {
+        return values[index.i + index.j * sizeX];
+    }
+
+    std::vector<T> &getValues() {
+        return values;
+    }
+
+    uint sizeX{}, sizeY{};
+
+private:
+    std::vector<T> values;
+
+    template<typename _T>
+    friend std::ostream &operator<<(std::ostream &os, Vector2D<_T> &vector);
+};
+
+template<typename T>
+std::ostream &operator<<(std::ostream &os, Vector2D<T> &vector) {
+    os << "[";
+    std::string lineSeparator;
+    for (uint j = 0; j < vector.sizeY; ++j) {
+        std::stringstream line;
+        std::string separator;
+        for (uint i = 0; i < vector.sizeX; ++i) {
+            line << separator << vector[{i, j}];
+            separator = ",";
+        }
+        os << lineSeparator << std::endl << "[" << line.str() << "]";
+        lineSeparator = ",";
+    }
+    os << "]";
+    return os;
+}
+
+double analyticFunction(double x, double y) {
+    return std::exp(-2 * x) * std::cos(2 * y);
+}
+
+bool isBorder(const Index2D &index, uint N) {
+    return index.i == 0 || index.j == 0 || index.i == N - 1 || index.j == N - 1;
+}
+
+std::string linspaceString(uint size, double step) {
+    std::stringstream result;
+    std::string separator;
+
+    result << "[";
+    for (uint i = 0; i < size; ++i) {
+        result << separator << i * step;
+        separator = ",";
+    }
+    result << "]";
+    return result.str();
+}
+
+template<typename T>
+struct SorResult {
+    std::string json;
+    double norm{};
+    uint steps{};
+    Vector2D<T> function{0};
+};
+
+//Iterate SOR in place until the residual is small, phi holds the initial guess and the border values.
+//Returns the number of sweeps.
+template<typename T>
+uint sorIterate(double step, double omega, Vector2D<T> &phi, const Vector2D<T> &r) {
+    PROFILE_PHASE("sor");
+    double maxResidual = 0;
+    uint steps = 0;
+    do {
+        steps++;
+        maxResidual = 0;
+        for (uint i = 1; i < phi.sizeX - 1; i++) {
+            for (uint j = 1; j < phi.sizeY - 1; j++) {
+                //main routine
+                //SOR step
+                auto currentResidual =
+                        -4 * phi[{i, j}] + phi[{i - 1, j}] + phi[{i + 1, j}] + phi[{i, j - 1}] + phi[{i, j + 1}] -
+                        r[{i, j}] * step * step;
+                phi[{i, j}] = phi[{i, j}] + omega * 1.0 / 4 * currentResidual;
+                if (std::abs(currentResidual) > maxResidual) maxResidual = std::abs(currentResidual);
+            }
+        }
+    } while (maxResidual > 1e-5 * step * step); // maxResidual is max(|residual|)
+    PROFILE_COUNT("sor sweeps", steps);
+    return steps;
+}
+
+//Solve with initial moved in as the starting field, e.g. a warm start from SorCache, see sorIterate
+template<typename T>
+SorResult<T> sor(double step, double omega, Vector2D<T> &&initial, const Vector2D<T> &rightHand) {
+    auto phi = std::move(initial);
+    auto steps = sorIterate(step, omega, phi, rightHand);
+
+    double norm = 0;
+    for (uint i = 1; i < phi.sizeX - 1; i++) {
+        for (uint j = 1; j < phi.sizeY - 1; j++) {
+            norm += std::abs(phi[{i, j}] - analyticFunction(i * step, j * step)) * step * step;
+        }
+    }
+
+    std::stringstream json;
+    json << "{\"phi\":" << phi << "," << std::endl;
+    json << "\"x\":" << linspaceString(phi.sizeX, step) << "," << std::endl;
+    json << "\"y\":" << linspaceString(phi.sizeY, step) << "}" << std::endl;
+
+    return {json.str(), norm, steps, std::move(phi)};
+}
+
+template<typename T>
+SorResult<T> sor(double step, double omega, const Vector2D<T> &initial, const Vector2D<T> &rightHand) {
+    return sor(step, omega, Vector2D<T>(initial), rightHand);
+}
+
+//Bilinear interpolation of values onto a sizeX x sizeY grid covering the same domain
+template<typename T>
+Vector2D<T> interpolate(const Vector2D<T> &values, uint sizeX, uint sizeY) {
+    Vector2D<T> result(sizeX, sizeY);
+    for (uint j = 0; j < sizeY; j++) {
+        auto y = (double) j * (values.sizeY - 1) / (sizeY - 1);
+        auto j0 = std::min((uint) y, values.sizeY - 2);
+        auto fy = y - j0;
+        for (uint i = 0; i < sizeX; i++) {
+            auto x = (double) i * (values.sizeX - 1) / (sizeX - 1);
+            auto i0 = std::min((uint) x, values.sizeX - 2);
+            auto fx = x - i0;
+            result[{i, j}] = (1 - fx) * (1 - fy) * values[{i0, j0}] + fx * (1 - fy) * values[{i0 + 1, j0}] +
+                             (1 - fx) * fy * values[{i0, j0 + 1}] + fx * fy * values[{i0 + 1, j0 + 1}];
+        }
+    }
+    return result;
+}
+
+template<typename T>
+void copyBorder(const Vector2D<T> &from, Vector2D<T> &to) {
+    for (uint j = 0; j < to.sizeY; j++) {
+        for (uint i = 0; i < to.sizeX; i++) {
+            if (i == 0 || j == 0 || i == to.sizeX - 1 || j == to.sizeY - 1) to[{i, j}] = from[{i, j}];
+        }
+    }
+}
+
+//Solutions of previous solves, the next solve starts from the one of the same grid size (only omega or the border
+//values changed) or from the one of the closest size interpolated onto the new grid (nested iteration).
+//The solutions are moved in and out, a re-solve on the same grid never copies the field.
+template<typename T>
+class SorCache {
+public:
+    //Initial guess for a problem with the border values of boundary. A stored solution of the same size is
+    //moved out of the cache, store the new solution back after the solve.
+    Vector2D<T> takeInitialGuess(const Vector2D<T> &boundary) {
+        if (solutions.empty()) return boundary;
+        auto distance = [&](const Vector2D<T> &solution) {
+            return std::abs((double) solution.sizeX - boundary.sizeX) +
+                   std::abs((double) solution.sizeY - boundary.sizeY);
+        };
+        auto nearest = std::min_element(solutions.begin(), solutions.end(),
+                                        [&](const Vector2D<T> &a, const Vector2D<T> &b) {
+                                            return distance(a) < distance(b);
+                                        });
+        Vector2D<T> guess{0};
+        if (distance(*nearest) == 0) {
+            guess = std::move(*nearest);
+            solutions.erase(nearest);
+        } else {
+            guess = interpolate(*nearest, boundary.sizeX, boundary.sizeY);
+        }
+        copyBorder(boundary, guess);
+        return guess;
+    }
+
+    //Replaces a stored solution of the same size
+    void store(Vector2D<T> &&solution) {
+        for (auto &stored : solutions) {
+            if (stored.sizeX == solution.sizeX && stored.sizeY == solution.sizeY) {
+                stored = std::move(solution);
+                return;
+            }
+        }
+        solutions.emplace_back(std::move(solution));
+    }
+
+private:
+    std::vector<Vector2D<T>> solutions;
+};
+
+struct ScalingTestResult {
+    double duration;
+    double potential;
+    SorResult<double> sorResult;
+};
+
+//Laplace equation on a gridSize x gridSize grid with the analytic border values, see sor.
+//With a cache the solve starts from the cached solutions and its solution is moved to the cache.
+ScalingTestResult scalingTest(uint gridSize, double omega = 1.84, SorCache<double> *cache = nullptr){
+    SorResult<double> result;
+
+    Vector2D<double> phi(gridSize);
+    Vector2D<double> r(gridSize);
+    double step = 1.0 / (gridSize - 1);
+
+    //Set border values, could be anything, eg. 2 electrodes
+    for (uint i = 0; i < gridSize; i++) {
+        for (uint j = 0; j < gridSize; j++) {
+            if (isBorder({i, j}, gridSize)) {
+                phi[{i, j}] = analyticFunction(i * step, j * step);
+            }
+        }
+    }
+    auto duration = timeIt([&]() {
+        result = cache ? sor(step, omega, cache->takeInitialGuess(phi), r) : sor(step, omega, std::move(phi), r);
+    });
+    auto potential = result.function[{(gridSize - 1) / 2, (gridSize - 1) / 2}];
+    if (cache) {
+        //The json is already built, the solution is moved into the cache and sorResult.function is left empty
+        cache->store(std::move(result.function));
+        result.function = Vector2D<double>(0);
+    }
+    return {duration, potential, std::move(result)};
+}
+
+#endif //PMPL_SOR_H
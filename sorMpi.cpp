@@ -0,0 +1,80 @@
+#include <mpi.h>
+#include <cmath>
+#include <iostream>
+#include <fstream>
+#include <string>
+#include "utils.h"
+#include "sor.h"
+#include "sorMpi.h"
+
+struct DistributedRun {
+    double duration;
+    uint steps;
+    double norm;
+};
+
+//Same problem as scalingTest on a sizeX x sizeY grid, see sor(const SlabDecomposition &, ...)
+DistributedRun distributedTest(uint sizeX, uint sizeY, double omega, const std::string &jsonFilename = "") {
+    SlabDecomposition slab(sizeX, sizeY, MPI_COMM_WORLD);
+    double step = 1.0 / (sizeX - 1);
+    auto initial = [&](uint i, uint j) {
+        return i == 0 || j == 0 || i == sizeX - 1 || j == sizeY - 1 ? analyticFunction(i * step, j * step) : 0.0;
+    };
+    auto rightHand = [](uint, uint) { return 0.0; };
+
+    SorResult<double> result;
+    MPI_Barrier(MPI_COMM_WORLD);
+    auto start = MPI_Wtime();
+    result = sor<double>(slab, step, omega, initial, rightHand);
+    auto duration = MPI_Wtime() - start;
+    //The slowest process sets the time
+    MPI_Allreduce(MPI_IN_PLACE, &duration, 1, MPI_DOUBLE, MPI_MAX, MPI_COMM_WORLD);
+
+    if (slab.rank == 0 && !jsonFilename.empty()) {
+        std::ofstream jsonFile(jsonFilename);
+        jsonFile << result.json;
+    }
+    return {duration, result.steps, result.norm};
+}
+
+//Usage: mpirun -np N SorMpi
+//Strong scaling on the square grids of scalingTest and weak scaling with weakRows rows per process.
+//Rank 0 appends one line per run to data/sor_mpi_scaling.csv, so runs with different N can be compared:
+//kind,processes,sizeX,sizeY,sweeps,duration,norm,serialSweeps,serialDuration
+int main(int argc, char *argv[]) {
+    MPI_Init(&argc, &argv);
+    int rank = 0, processCount = 1;
+    MPI_Comm_rank(MPI_COMM_WORLD, &rank);
+    MPI_Comm_size(MPI_COMM_WORLD, &processCount);
+    const double omega = 1.84;
+    const uint weakColumns = 202, weakRows = 100;
+
+    std::ofstream scalingFile;
+    if (rank == 0) scalingFile.open("data/sor_mpi_scaling.csv", std::ios::app);
+
+    for (uint gridSize : {102u, 202u}) {
+        auto run = distributedTest(gridSize, gridSize, omega, gridSize == 202 ? "data/sor_mpi.json" : "");
+        if (rank == 0) {
+            //The serial lexicographic sweep of sor.cpp on the same grid
+            auto serial = scalingTest(gridSize, omega);
+            std::cout << "Strong " << gridSize << "x" << gridSize << " on " << processCount << " processes: "
+                      << run.duration << "s, " << run.steps << " sweeps, serial " << serial.duration << "s, "
+                      << serial.sorResult.steps << " sweeps" << std::endl;
+            scalingFile << "strong," << processCount << "," << gridSize << "," << gridSize << "," << run.steps << ","
+                        << run.duration << "," << run.norm << "," << serial.sorResult.steps << ","
+                        << serial.duration << std::endl;
+        }
+    }
+
+    //Every process keeps weakRows interior rows, the sweep count grows with the grid so compare time per sweep
+    auto sizeY = weakRows * processCount + 2;
+    auto run = distributedTest(weakColumns, sizeY, omega);
+    if (rank == 0) {
+        std::cout << "Weak " << weakColumns << "x" << sizeY << " on " << processCount << " processes: "
+                  << run.duration / run.steps << "s per sweep" << std::endl;
+        scalingFile << "weak," << processCount << "," << weakColumns << "," << sizeY << "," << run.steps << ","
+                    << run.duration << "," << run.norm << ",," << std::endl;
+    }
+
+    MPI_Finalize();
+}
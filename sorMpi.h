@@ -0,0 +1,178 @@
+#ifndef PMPL_SOR_MPI_H
+#define PMPL_SOR_MPI_H
+
+#include <mpi.h>
+#include <vector>
+#include <cmath>
+#include <stdexcept>
+#include "sor.h"
+
+template<typename T>
+MPI_Datatype getMpiType();
+
+template<>
+MPI_Datatype getMpiType<double>() {
+    return MPI_DOUBLE;
+}
+
+template<>
+MPI_Datatype getMpiType<float>() {
+    return MPI_FLOAT;
+}
+
+//A sizeX x sizeY grid split into horizontal slabs, one per process of the communicator. The interior rows
+//1..sizeY-2 are split as evenly as possible, a slab stores its rows and one halo row below and above them.
+//For the first and the last process the halo is the fixed border row of the grid.
+//Rows are contiguous in Vector2D, so a halo is sent as is without packing.
+struct SlabDecomposition {
+    SlabDecomposition(uint sizeX, uint sizeY, MPI_Comm communicator) :
+            sizeX(sizeX),
+            sizeY(sizeY),
+            communicator(communicator) {
+        MPI_Comm_rank(communicator, &rank);
+        MPI_Comm_size(communicator, &processCount);
+        if (sizeY < 2 + (uint) processCount) {
+            throw std::invalid_argument("Every process needs at least one interior row.");
+        }
+        firstRow = getFirstRow(rank);
+        rowCount = getFirstRow(rank + 1) - firstRow;
+        lower = rank > 0 ? rank - 1 : MPI_PROC_NULL;
+        upper = rank < processCount - 1 ? rank + 1 : MPI_PROC_NULL;
+    }
+
+    //Global row of the first interior row of the slab of the process, one past the last for processCount
+    uint getFirstRow(int process) const {
+        auto interior = sizeY - 2;
+        return 1 + (uint) ((unsigned long) interior * process / processCount);
+    }
+
+    //Local storage of the slab, local row j is global row firstRow - 1 + j
+    template<typename T>
+    Vector2D<T> create() const {
+        return Vector2D<T>(sizeX, rowCount + 2);
+    }
+
+    //Set every stored value (halos included) to function(i, globalRow)
+    template<typename T, typename Function>
+    void fill(Vector2D<T> &slab, Function function) const {
+        for (uint j = 0; j < rowCount + 2; j++) {
+            for (uint i = 0; i < sizeX; i++) {
+                slab[{i, j}] = function(i, firstRow - 1 + j);
+            }
+        }
+    }
+
+    uint sizeX, sizeY;
+    MPI_Comm communicator;
+    int rank{}, processCount{};
+    uint firstRow, rowCount;
+    int lower, upper; //neighbouring processes or MPI_PROC_NULL
+};
+
+//Send the first and the last row of the slab to the neighbours and receive their rows into the halos
+template<typename T>
+void exchangeHalos(const SlabDecomposition &slab, Vector2D<T> &phi) {
+    auto *values = phi.getValues().data();
+    const int count = (int) slab.sizeX;
+    auto *lowerHalo = values;
+    auto *firstRow = values + slab.sizeX;
+    auto *lastRow = values + (size_t) slab.rowCount * slab.sizeX;
+    auto *upperHalo = values + (size_t) (slab.rowCount + 1) * slab.sizeX;
+    MPI_Sendrecv(firstRow, count, getMpiType<T>(), slab.lower, 0, upperHalo, count, getMpiType<T>(), slab.upper, 0,
+                 slab.communicator, MPI_STATUS_IGNORE);
+    MPI_Sendrecv(lastRow, count, getMpiType<T>(), slab.upper, 1, lowerHalo, count, getMpiType<T>(), slab.lower, 1,
+                 slab.communicator, MPI_STATUS_IGNORE);
+}
+
+//Same as sorIterate, but in red-black order so the two colours of a sweep can be updated independently on every
+//slab. The halos are exchanged after each half-sweep and the residual is reduced over all the processes once
+//per sweep. Returns the number of sweeps.
+template<typename T>
+uint sorIterate(const SlabDecomposition &slab, double step, double omega, Vector2D<T> &phi, const Vector2D<T> &r) {
+    PROFILE_PHASE("sor");
+    double maxResidual = 0;
+    uint steps = 0;
+    do {
+        steps++;
+        double localResidual = 0;
+        for (uint colour = 0; colour < 2; colour++) {
+            for (uint j = 1; j <= slab.rowCount; j++) {
+                //First interior i of the colour, a point is red if i + j (global) is even
+                auto globalJ = slab.firstRow - 1 + j;
+                auto first = 1 + (1 + globalJ + colour) % 2;
+                for (uint i = first; i < phi.sizeX - 1; i += 2) {
+                    //main routine
+                    //SOR step
+                    auto currentResidual =
+                            -4 * phi[{i, j}] + phi[{i - 1, j}] + phi[{i + 1, j}] + phi[{i, j - 1}] + phi[{i, j + 1}] -
+                            r[{i, j}] * step * step;
+                    phi[{i, j}] = phi[{i, j}] + omega * 1.0 / 4 * currentResidual;
+                    if (std::abs(currentResidual) > localResidual) localResidual = std::abs(currentResidual);
+                }
+            }
+            exchangeHalos(slab, phi);
+        }
+        MPI_Allreduce(&localResidual, &maxResidual, 1, MPI_DOUBLE, MPI_MAX, slab.communicator);
+    } while (maxResidual > 1e-5 * step * step); // maxResidual is max(|residual|)
+    PROFILE_COUNT("sor sweeps", steps);
+    return steps;
+}
+
+//The whole grid on the root process (border rows included), an empty grid on the others
+template<typename T>
+Vector2D<T> gather(const SlabDecomposition &slab, const Vector2D<T> &phi, int root = 0) {
+    //Every process sends its interior rows, the first and the last one also their border row
+    auto getRows = [&](int process, uint &first, uint &count) {
+        first = process == 0 ? 0 : slab.getFirstRow(process);
+        auto end = process == slab.processCount - 1 ? slab.sizeY : slab.getFirstRow(process + 1);
+        count = end - first;
+    };
+    uint first = 0, count = 0;
+    getRows(slab.rank, first, count);
+    const auto *send = &phi[{0, first - (slab.firstRow - 1)}];
+
+    std::vector<int> counts, displacements;
+    Vector2D<T> result(slab.rank == root ? slab.sizeX : 0, slab.rank == root ? slab.sizeY : 0);
+    if (slab.rank == root) {
+        for (int process = 0; process < slab.processCount; process++) {
+            uint processFirst = 0, processCount = 0;
+            getRows(process, processFirst, processCount);
+            counts.emplace_back((int) (processCount * slab.sizeX));
+            displacements.emplace_back((int) (processFirst * slab.sizeX));
+        }
+    }
+    MPI_Gatherv(send, (int) (count * slab.sizeX), getMpiType<T>(), result.getValues().data(), counts.data(),
+                displacements.data(), getMpiType<T>(), root, slab.communicator);
+    return result;
+}
+
+//Distributed sor, the initial guess with the border values and the right hand side are given as functions of
+//the global (i, j) so no process ever holds the whole grid. Only the root gets the json and the function.
+template<typename T, typename Initial, typename RightHand>
+SorResult<T> sor(const SlabDecomposition &slab, double step, double omega, Initial initial, RightHand rightHand) {
+    auto phi = slab.create<T>();
+    auto r = slab.create<T>();
+    slab.fill(phi, initial);
+    slab.fill(r, rightHand);
+    auto steps = sorIterate(slab, step, omega, phi, r);
+
+    double localNorm = 0, norm = 0;
+    for (uint j = 1; j <= slab.rowCount; j++) {
+        for (uint i = 1; i < phi.sizeX - 1; i++) {
+            auto globalJ = slab.firstRow - 1 + j;
+            localNorm += std::abs(phi[{i, j}] - analyticFunction(i * step, globalJ * step)) * step * step;
+        }
+    }
+    MPI_Allreduce(&localNorm, &norm, 1, MPI_DOUBLE, MPI_SUM, slab.communicator);
+
+    auto function = gather(slab, phi);
+    std::stringstream json;
+    if (slab.rank == 0) {
+        json << "{\"phi\":" << function << "," << std::endl;
+        json << "\"x\":" << linspaceString(function.sizeX, step) << "," << std::endl;
+        json << "\"y\":" << linspaceString(function.sizeY, step) << "}" << std::endl;
+    }
+    return {json.str(), norm, steps, function};
+}
+
+#endif //PMPL_SOR_MPI_H
@@ -0,0 +1,154 @@
+#ifndef PMPL_UNITS_H
+#define PMPL_UNITS_H
+
+#include <vector>
+#include "boris.h"
+
+//Storage of the scaled blocks, double unless the build sets PMPL_SINGLE_PRECISION
+#ifdef PMPL_SINGLE_PRECISION
+using Scalar = float;
+#else
+using Scalar = double;
+#endif
+
+//Units of a dimensionless run. The fields follow from the base units so that q/m E and q/m B keep their form,
+//only the speed of light changes to c * time / length. Conversions happen when a block is scaled and unscaled,
+//the pushers only see values of order one, which float can hold.
+struct UnitSystem {
+    double length, time, mass, charge;
+
+    //One time step is the unit of time and the species mass and charge are one, length is e.g. the distance
+    //a typical particle travels in one step
+    static UnitSystem forSpecies(double mass, double charge, double timeStep, double length) {
+        return {length, timeStep, mass, std::abs(charge)};
+    }
+
+    double getVelocity() const {
+        return length / time;
+    }
+
+    double getElectricField() const {
+        return mass * length / (charge * time * time);
+    }
+
+    double getMagneticField() const {
+        return mass / (charge * time);
+    }
+
+    Vector scaleElectricField(const Vector &E) const {
+        return 1 / getElectricField() * E;
+    }
+
+    Vector scaleMagneticField(const Vector &B) const {
+        return 1 / getMagneticField() * B;
+    }
+};
+
+//The block in the given units stored as T
+template<typename T>
+BasicParticleBlock<T> toScaled(const ParticleBlock &block, const UnitSystem &units) {
+    BasicParticleBlock<T> result(block.mass / units.mass, block.charge / units.charge,
+                                 block.speedOfLight / units.getVelocity());
+    auto scale = [](const std::vector<double> &from, std::vector<T> &to, double unit) {
+        to.resize(from.size());
+        for (size_t n = 0; n < from.size(); n++) to[n] = (T) (from[n] / unit);
+    };
+    auto velocity = units.getVelocity();
+    scale(block.x, result.x, units.length);
+    scale(block.y, result.y, units.length);
+    scale(block.z, result.z, units.length);
+    scale(block.vx, result.vx, velocity);
+    scale(block.vy, result.vy, velocity);
+    scale(block.vz, result.vz, velocity);
+    scale(block.previousVx, result.previousVx, velocity);
+    scale(block.previousVy, result.previousVy, velocity);
+    scale(block.previousVz, result.previousVz, velocity);
+    scale(block.ux, result.ux, velocity);
+    scale(block.uy, result.uy, velocity);
+    scale(block.uz, result.uz, velocity);
+    scale(block.gamma, result.gamma, 1);
+    result.indices = block.indices;
+    return result;
+}
+
+//Back to SI units in double, e.g. for mergeBySpecies and the outputs
+template<typename T>
+ParticleBlock fromScaled(const BasicParticleBlock<T> &block, const UnitSystem &units) {
+    ParticleBlock result(block.mass * units.mass, block.charge * units.charge,
+                         block.speedOfLight * units.getVelocity());
+    auto unscale = [](const std::vector<T> &from, std::vector<double> &to, double unit) {
+        to.resize(from.size());
+        for (size_t n = 0; n < from.size(); n++) to[n] = from[n] * unit;
+    };
+    auto velocity = units.getVelocity();
+    unscale(block.x, result.x, units.length);
+    unscale(block.y, result.y, units.length);
+    unscale(block.z, result.z, units.length);
+    unscale(block.vx, result.vx, velocity);
+    unscale(block.vy, result.vy, velocity);
+    unscale(block.vz, result.vz, velocity);
+    unscale(block.previousVx, result.previousVx, velocity);
+    unscale(block.previousVy, result.previousVy, velocity);
+    unscale(block.previousVz, result.previousVz, velocity);
+    unscale(block.ux, result.ux, velocity);
+    unscale(block.uy, result.uy, velocity);
+    unscale(block.uz, result.uz, velocity);
+    unscale(block.gamma, result.gamma, 1);
+    result.indices = block.indices;
+    return result;
+}
+
+//Largest deviation of positions [m] and velocities [m/s] of block from reference, relative to the largest
+//position and velocity of reference
+struct BlockDeviation {
+    double position, velocity;
+};
+
+BlockDeviation getDeviation(const ParticleBlock &block, const ParticleBlock &reference) {
+    double maxPosition = 0, maxVelocity = 0, positionError = 0, velocityError = 0;
+    for (size_t n = 0; n < reference.size(); n++) {
+        Vector position{reference.x[n], reference.y[n], reference.z[n]};
+        Vector velocity{reference.vx[n], reference.vy[n], reference.vz[n]};
+        maxPosition = std::max(maxPosition, position.getNorm());
+        maxVelocity = std::max(maxVelocity, velocity.getNorm());
+        positionError = std::max(positionError, (Vector{block.x[n], block.y[n], block.z[n]} - position).getNorm());
+        velocityError = std::max(velocityError, (Vector{block.vx[n], block.vy[n], block.vz[n]} - velocity).getNorm());
+    }
+    return {positionError / maxPosition, velocityError / maxVelocity};
+}
+
+//Push copies of the block steps times in SI units, in scaled double and in scaled float and print how far
+//the scaled runs got from the SI run together with the throughputs.
+//push(block, timeStep, E, B) makes one step of any BasicParticleBlock.
+template<typename Push>
+void reportScaledPrecision(
+        const ParticleBlock &block,
+        const UnitSystem &units,
+        double timeStep,
+        const Vector &E,
+        const Vector &B,
+        int steps,
+        Push push
+) {
+    auto reference = block;
+    auto referenceDuration = timeIt([&]() {
+        for (int step = 0; step < steps; step++) push(reference, timeStep, E, B);
+    });
+    std::cout << "SI double: " << block.size() * steps / referenceDuration << " particles/s" << std::endl;
+
+    auto scaledE = units.scaleElectricField(E);
+    auto scaledB = units.scaleMagneticField(B);
+    auto scaledTimeStep = timeStep / units.time;
+    auto report = [&](auto scaled, const std::string &name) {
+        auto duration = timeIt([&]() {
+            for (int step = 0; step < steps; step++) push(scaled, scaledTimeStep, scaledE, scaledB);
+        });
+        auto deviation = getDeviation(fromScaled(scaled, units), reference);
+        std::cout << name << ": " << block.size() * steps / duration << " particles/s, relative deviation of "
+                  << "positions " << deviation.position << ", velocities " << deviation.velocity << std::endl;
+    };
+    report(toScaled<double>(block, units), "Scaled double");
+    report(toScaled<float>(block, units), "Scaled float");
+}
+
+#endif //PMPL_UNITS_H
@@ -2,6 +2,14 @@
 #define PMPL_UTILS_H
 
 #include <chrono>
+#include <string>
+#include <vector>
+#include <mutex>
+#include <algorithm>
+#include <iostream>
+#include <iomanip>
+#include <fstream>
+#include <cmath>
 
 template <typename Function>
 double timeIt(Function function) {
@@ -12,4 +20,178 @@ double timeIt(Function function) {
     return nanosecondDuration * 1e-9;
 }
 
+//Times of named phases and counts of named events. Names are registered once per call site and turned into indices,
+//every thread accumulates into its own thread_local totals so the hot path takes no lock.
+//The totals are summed only by the report, which is meant to be called when the worker threads are done.
+//Use the PROFILE_* macros below, they compile out unless PMPL_PROFILE is defined.
+class Profiler {
+public:
+    static Profiler &instance() {
+        static Profiler profiler;
+        return profiler;
+    }
+
+    size_t registerPhase(const std::string &name) {
+        return registerName(phaseNames, name);
+    }
+
+    size_t registerCounter(const std::string &name) {
+        return registerName(counterNames, name);
+    }
+
+    void addTime(size_t phase, double seconds) {
+        auto &totals = getThreadTotals();
+        if (phase >= totals.times.size()) totals.resizePhases(phase + 1);
+        totals.times[phase] += seconds;
+        totals.calls[phase]++;
+    }
+
+    void addCount(size_t counter, long count) {
+        auto &totals = getThreadTotals();
+        if (counter >= totals.counts.size()) totals.counts.resize(counter + 1);
+        totals.counts[counter] += count;
+    }
+
+    //Phases are inclusive, a phase called inside another one is counted in both
+    void report(double totalTime, std::ostream &os = std::cout) {
+        auto totals = sum();
+        os << std::left << std::setw(24) << "phase" << std::setw(14) << "time [s]" << std::setw(10) << "share"
+           << std::setw(14) << "calls" << "calls/s" << std::endl;
+        for (size_t i = 0; i < phaseNames.size(); i++) {
+            os << std::setw(24) << phaseNames[i] << std::setw(14) << totals.times[i]
+               << std::setw(10) << std::to_string((int) std::round(100 * totals.times[i] / totalTime)) + "%"
+               << std::setw(14) << totals.calls[i] << totals.calls[i] / totals.times[i] << std::endl;
+        }
+        os << std::setw(24) << "counter" << std::setw(24) << "count" << "per second" << std::endl;
+        for (size_t i = 0; i < counterNames.size(); i++) {
+            os << std::setw(24) << counterNames[i] << std::setw(24) << totals.counts[i]
+               << totals.counts[i] / totalTime << std::endl;
+        }
+        os << std::right;
+    }
+
+    void reportJson(double totalTime, const std::string &filename) {
+        auto totals = sum();
+        std::ofstream file(filename);
+        file << "{\"totalTime\":" << totalTime << "," << std::endl << "\"phases\":[";
+        for (size_t i = 0; i < phaseNames.size(); i++) {
+            file << (i ? "," : "") << std::endl << "{\"name\":\"" << phaseNames[i] << "\",\"time\":" << totals.times[i]
+                 << ",\"calls\":" << totals.calls[i] << "}";
+        }
+        file << "]," << std::endl << "\"counters\":[";
+        for (size_t i = 0; i < counterNames.size(); i++) {
+            file << (i ? "," : "") << std::endl << "{\"name\":\"" << counterNames[i] << "\",\"count\":"
+                 << totals.counts[i] << ",\"rate\":" << totals.counts[i] / totalTime << "}";
+        }
+        file << "]}" << std::endl;
+    }
+
+private:
+    struct Totals {
+        std::vector<double> times;
+        std::vector<long> calls;
+        std::vector<long> counts;
+
+        void resizePhases(size_t size) {
+            times.resize(size);
+            calls.resize(size);
+        }
+
+        void add(const Totals &other) {
+            resizePhases(std::max(times.size(), other.times.size()));
+            counts.resize(std::max(counts.size(), other.counts.size()));
+            for (size_t i = 0; i < other.times.size(); i++) {
+                times[i] += other.times[i];
+                calls[i] += other.calls[i];
+            }
+            for (size_t i = 0; i < other.counts.size(); i++) counts[i] += other.counts[i];
+        }
+    };
+
+    //Registers the totals of a thread, a finished thread moves them to the retired totals
+    struct ThreadTotals {
+        Totals totals;
+
+        ThreadTotals() {
+            auto &profiler = instance();
+            std::lock_guard<std::mutex> lock(profiler.mutex);
+            profiler.threads.emplace_back(&totals);
+        }
+
+        ~ThreadTotals() {
+            auto &profiler = instance();
+            std::lock_guard<std::mutex> lock(profiler.mutex);
+            profiler.retired.add(totals);
+            profiler.threads.erase(std::find(profiler.threads.begin(), profiler.threads.end(), &totals));
+        }
+    };
+
+    std::mutex mutex;
+    std::vector<std::string> phaseNames;
+    std::vector<std::string> counterNames;
+    std::vector<Totals *> threads;
+    Totals retired;
+
+    static Totals &getThreadTotals() {
+        static thread_local ThreadTotals threadTotals;
+        return threadTotals.totals;
+    }
+
+    size_t registerName(std::vector<std::string> &names, const std::string &name) {
+        std::lock_guard<std::mutex> lock(mutex);
+        auto it = std::find(names.begin(), names.end(), name);
+        if (it != names.end()) return it - names.begin();
+        names.emplace_back(name);
+        return names.size() - 1;
+    }
+
+    Totals sum() {
+        std::lock_guard<std::mutex> lock(mutex);
+        Totals result = retired;
+        for (auto totals : threads) result.add(*totals);
+        result.resizePhases(std::max(result.times.size(), phaseNames.size()));
+        result.counts.resize(std::max(result.counts.size(), counterNames.size()));
+        return result;
+    }
+};
+
+class ScopedPhaseTimer {
+public:
+    explicit ScopedPhaseTimer(size_t phase) : phase(phase), start(std::chrono::steady_clock::now()) {}
+
+    ~ScopedPhaseTimer() {
+        auto end = std::chrono::steady_clock::now();
+        Profiler::instance().addTime(phase, std::chrono::duration<double>(end - start).count());
+    }
+
+private:
+    size_t phase;
+    std::chrono::steady_clock::time_point start;
+};
+
+#define PMPL_CONCAT_(a, b) a##b
+#define PMPL_CONCAT(a, b) PMPL_CONCAT_(a, b)
+
+#ifdef PMPL_PROFILE
+//Time the rest of the enclosing scope as the phase name
+#define PROFILE_PHASE(name) \
+    static const size_t PMPL_CONCAT(profilePhase, __LINE__) = Profiler::instance().registerPhase(name); \
+    ScopedPhaseTimer PMPL_CONCAT(profileTimer, __LINE__)(PMPL_CONCAT(profilePhase, __LINE__))
+#define PROFILE_COUNT(name, count) \
+    do { \
+        static const size_t profileCounter = Profiler::instance().registerCounter(name); \
+        Profiler::instance().addCount(profileCounter, count); \
+    } while (false)
+//Text report to std::cout and JSON report to the file, totalTime is the wall time of the run
+#define PROFILE_REPORT(totalTime, filename) \
+    do { \
+        Profiler::instance().report(totalTime); \
+        Profiler::instance().reportJson(totalTime, filename); \
+    } while (false)
+#else
+#define PROFILE_PHASE(name) do {} while (false)
+#define PROFILE_COUNT(name, count) do {} while (false)
+#define PROFILE_REPORT(totalTime, filename) do {} while (false)
+#endif
+
 #endif //PMPL_UTILS_H